@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * spi-hid-capture.h
+ *
+ * Binary transaction capture format, shared by the driver and the
+ * userspace replay tools.
+ *
+ * A capture is a stream of records, each starting on an 8 byte boundary.
+ * The driver writes them to the per-CPU relay files capture0..N under the
+ * device's debugfs directory; seq orders records across those files.
+ * Readers that mmap the relay buffers skip sub-buffer padding by stepping
+ * 8 bytes at a time until the next magic.
+ */
+
+#ifndef SPI_HID_CAPTURE_H
+#define SPI_HID_CAPTURE_H
+
+#include <linux/types.h>
+
+#define SPI_HID_CAP_MAGIC		0x50434853	/* "SHCP" */
+#define SPI_HID_CAP_VERSION		1
+#define SPI_HID_CAP_ALIGN		8
+
+/* Record types */
+#define SPI_HID_CAP_START		0	/* data is struct spi_hid_cap_start */
+#define SPI_HID_CAP_INPUT		1	/* input header + body as read */
+#define SPI_HID_CAP_OUTPUT		2	/* output message as written */
+
+struct spi_hid_cap_rec {
+	__u32 magic;
+	__u32 size;		/* whole record including padding */
+	__u64 seq;
+	__u64 ts_ns;		/* CLOCK_MONOTONIC */
+	__u8 type;
+	__u8 version;
+	__u16 hdr_len;		/* header bytes at the start of data */
+	__u32 len;		/* header + body bytes in data */
+	__u8 data[];
+};
+
+/* Written whenever a capture is started */
+struct spi_hid_cap_start {
+	__u16 vendor_id;
+	__u16 product_id;
+	__u16 version_id;
+	__u16 hid_version;
+	__u16 max_input_length;
+	__u16 max_output_length;
+	__u32 reserved;
+};
+
+#define SPI_HID_CAP_REC_SIZE(len) \
+	(((sizeof(struct spi_hid_cap_rec) + (len)) + SPI_HID_CAP_ALIGN - 1) & \
+			~(SPI_HID_CAP_ALIGN - 1))
+
+#endif
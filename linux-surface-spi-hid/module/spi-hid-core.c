@@ -43,18 +43,67 @@
 #include <linux/mutex.h>
 #include <linux/of.h>
 #include <linux/pinctrl/consumer.h>
+#include <linux/pm_runtime.h>
 #include <linux/regulator/consumer.h>
 #include <linux/workqueue.h>
+#include <linux/sched/prio.h>
 #include <linux/dma-mapping.h>
 #include <linux/crc32.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <linux/kernel.h>
 #include <linux/gpio.h>
 #include <linux/gpio/consumer.h>
+#include <linux/random.h>
+#include <linux/relay.h>
 
+#include "spi-hid-capture.h"
 #include "spi-hid-core.h"
 #include "spi-hid_trace.h"
 
 #define SPI_HID_MAX_RESET_ATTEMPTS 3
+#define SPI_HID_RESPONSE_TIMEOUT_MS 1000
+#define SPI_HID_OUTPUT_TIMEOUT_MS 1000
+#define SPI_HID_RECOVERY_WINDOW_MS 2000
+
+#define SPI_HID_RESET_RESPONSE_TIMEOUT_MS 1000
+#define SPI_HID_RESET_BACKOFF_BASE_MS 50
+/* One reset attempt is given back for every period without a reset */
+#define SPI_HID_RESET_BUDGET_DECAY_MS 30000
+
+#define SPI_HID_AUTOSUSPEND_DELAY_MS 2000
+#define SPI_HID_OFF_DELAY_MS 60000
+#define SPI_HID_OPEN_GRACE_MS 10000
+
+#define SPI_HID_LOWLAT_IDLE_MS 500
+
+#define SPI_HID_LAT_LOG_MAX_DEPTH (1 << 20)
+
+#define SPI_HID_CAP_SUBBUF_SIZE (256 * 1024)
+#define SPI_HID_CAP_SUBBUFS 8
+#define SPI_HID_REPLAY_MAX_WRITE (64 * 1024)
+
+#define SPI_HID_WD_TIMEOUT_MS 3000
+#define SPI_HID_WD_SLO_FRAMES 8
+
+#define SPI_HID_CLK_UP_REPORTS 4
+#define SPI_HID_CLK_IDLE_MS 200
+
+#define SPI_HID_CLK_CAL_READS 32
+#define SPI_HID_CLK_CAL_MARGIN_STEPS 1
+#define SPI_HID_CLK_CAL_SETTLE_MS 20
+
+static bool calibrate_clock;
+module_param(calibrate_clock, bool, 0444);
+MODULE_PARM_DESC(calibrate_clock, "Calibrate the SPI clock at first bring-up");
+
+static struct dentry *spi_hid_debugfs_root;
+
+/* Rates of the AMD SPI controller, fastest first */
+static const u32 spi_hid_clk_cal_hz[SPI_HID_CLK_CAL_STEPS] = {
+	100000000, 66660000, 50000000, 33330000, 22220000, 16660000,
+	4000000, 3170000, 800000,
+};
 
 /* Windows-style power management function declarations for MSHW0231 */
 static int spi_hid_send_power_transition(struct spi_hid *shid, u8 power_state);
@@ -62,7 +111,8 @@ static int spi_hid_send_reset_notification(struct spi_hid *shid);
 static int spi_hid_send_enhanced_power_mgmt(struct spi_hid *shid, u8 enable);
 static int spi_hid_send_selective_suspend(struct spi_hid *shid, u8 enable);
 static int spi_hid_send_gpio_wake_pulse(struct spi_hid *shid);
-static int spi_hid_get_request(struct spi_hid *shid, u8 content_id);
+static int spi_hid_get_request(struct spi_hid *shid, u8 content_id,
+		u8 *buf, u16 len);
 static bool spi_hid_is_mshw0231(struct spi_hid *shid);
 static int spi_hid_parse_mshw0231_collections(struct spi_hid *shid, struct hid_device *hid, u8 *descriptor, int len);
 static int spi_hid_parse_collection_06(struct spi_hid *shid, struct hid_device *hid, u8 *descriptor, int len);
@@ -81,14 +131,583 @@ static int spi_hid_send_collection_06_power_mgmt(struct spi_hid *shid);
 /* Windows-style interrupt-driven SPI functions */
 static void spi_hid_windows_staged_init_work(struct work_struct *work);
 static void spi_hid_windows_staging_timer(struct timer_list *timer);
+static void spi_hid_windows_stage_event(struct spi_hid *shid, int event);
 static int spi_hid_windows_interrupt_setup(struct spi_hid *shid);
 static int spi_hid_windows_staged_command(struct spi_hid *shid, u8 stage);
 
 static struct hid_ll_driver spi_hid_ll_driver;
 
+static const char *const spi_hid_timeline_names[SPI_HID_TL_MILESTONES] = {
+	[SPI_HID_TL_PROBE] = "probe",
+	[SPI_HID_TL_BRINGUP] = "bringup",
+	[SPI_HID_TL_RESET_DEASSERT] = "reset_deassert",
+	[SPI_HID_TL_RESET_RESPONSE] = "reset_response",
+	[SPI_HID_TL_DEVICE_DESC] = "device_desc",
+	[SPI_HID_TL_CREATE_DEVICE] = "create_device",
+	[SPI_HID_TL_LL_PARSE] = "ll_parse",
+	[SPI_HID_TL_REPORT_DESC] = "report_desc",
+	[SPI_HID_TL_HID_CREATED] = "hid_created",
+	[SPI_HID_TL_LL_OPEN] = "ll_open",
+	[SPI_HID_TL_FIRST_INPUT] = "first_input",
+	[SPI_HID_TL_STAGE_0 + 0] = "stage0_initial",
+	[SPI_HID_TL_STAGE_0 + 1] = "stage1_acpi_setup",
+	[SPI_HID_TL_STAGE_0 + 2] = "stage2_gpio_reset",
+	[SPI_HID_TL_STAGE_0 + 3] = "stage3_small_commands",
+	[SPI_HID_TL_STAGE_0 + 4] = "stage4_medium_commands",
+	[SPI_HID_TL_STAGE_0 + 5] = "stage5_large_commands",
+	[SPI_HID_TL_STAGE_0 + 6] = "stage6_operational",
+};
+
+/* Records @milestone the first time it is reached. Safe from any context. */
+static void spi_hid_timeline_mark(struct spi_hid *shid, int milestone)
+{
+	u64 now = ktime_get_ns();
+	u64 probe_ns = atomic64_read(&shid->timeline_ns[SPI_HID_TL_PROBE]);
+
+	if (atomic64_cmpxchg(&shid->timeline_ns[milestone], 0, now))
+		return;
+
+	if (milestone == SPI_HID_TL_PROBE)
+		probe_ns = now;
+
+	trace_spi_hid_timeline(shid, milestone,
+			div_u64(now - probe_ns, NSEC_PER_USEC),
+			div_u64(now - max(shid->timeline_last_ns, probe_ns),
+				NSEC_PER_USEC));
+	shid->timeline_last_ns = max(shid->timeline_last_ns, now);
+}
+
+static int spi_hid_timeline_show(struct seq_file *m, void *v)
+{
+	struct spi_hid *shid = m->private;
+	u64 timeline_ns[SPI_HID_TL_MILESTONES];
+	u8 order[SPI_HID_TL_MILESTONES];
+	u64 probe_ns, prev_ns;
+	int count = 0;
+	int i, j;
+
+	for (i = 0; i < SPI_HID_TL_MILESTONES; i++)
+		timeline_ns[i] = atomic64_read(&shid->timeline_ns[i]);
+	probe_ns = timeline_ns[SPI_HID_TL_PROBE];
+	prev_ns = probe_ns;
+
+	/* Milestones in the order they were reached */
+	for (i = 0; i < SPI_HID_TL_MILESTONES; i++) {
+		if (!timeline_ns[i])
+			continue;
+
+		for (j = count; j > 0 &&
+			timeline_ns[order[j - 1]] > timeline_ns[i]; j--)
+			order[j] = order[j - 1];
+		order[j] = i;
+		count++;
+	}
+
+	seq_printf(m, "%-24s %12s %12s\n", "milestone", "t_us", "delta_us");
+	for (i = 0; i < count; i++) {
+		u64 ts = timeline_ns[order[i]];
+
+		seq_printf(m, "%-24s %12llu %12llu\n",
+				spi_hid_timeline_names[order[i]],
+				div_u64(ts - probe_ns, NSEC_PER_USEC),
+				div_u64(ts - prev_ns, NSEC_PER_USEC));
+		prev_ns = ts;
+	}
+
+	if (timeline_ns[SPI_HID_TL_FIRST_INPUT])
+		seq_printf(m, "total_us %llu\n",
+				div_u64(timeline_ns[SPI_HID_TL_FIRST_INPUT] -
+					probe_ns, NSEC_PER_USEC));
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(spi_hid_timeline);
+
+static const char *const spi_hid_stat_names[SPI_HID_STAT_COUNTERS] = {
+	[SPI_HID_STAT_IRQS] = "irqs",
+	[SPI_HID_STAT_IRQS_COALESCED] = "irqs_coalesced",
+	[SPI_HID_STAT_REPORTS] = "reports",
+	[SPI_HID_STAT_BYTES_IN] = "bytes_in",
+	[SPI_HID_STAT_OUTPUTS] = "outputs",
+	[SPI_HID_STAT_BYTES_OUT] = "bytes_out",
+	[SPI_HID_STAT_DROPS] = "drops",
+	[SPI_HID_STAT_BUS_ERRORS] = "bus_errors",
+	[SPI_HID_STAT_LOGIC_ERRORS] = "logic_errors",
+	[SPI_HID_STAT_REGULATOR_ERRORS] = "regulator_errors",
+	[SPI_HID_STAT_DEVICE_RESETS] = "device_resets",
+};
+
+static void spi_hid_stat_inc(struct spi_hid *shid, int counter)
+{
+	this_cpu_inc(shid->stats->count[counter]);
+}
+
+static void spi_hid_stat_add(struct spi_hid *shid, int counter, u64 val)
+{
+	this_cpu_add(shid->stats->count[counter], val);
+}
+
+static u64 spi_hid_stat_sum(struct spi_hid *shid, int counter)
+{
+	u64 sum = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		sum += READ_ONCE(per_cpu_ptr(shid->stats, cpu)->count[counter]);
+
+	return sum;
+}
+
+/* Called with input_lock held */
+static void spi_hid_stats_rate(struct spi_hid *shid, u64 now)
+{
+	u64 elapsed = now - shid->stats_rate_ns;
+	u64 reports, bytes;
+
+	if (elapsed < NSEC_PER_SEC)
+		return;
+
+	reports = spi_hid_stat_sum(shid, SPI_HID_STAT_REPORTS);
+	bytes = spi_hid_stat_sum(shid, SPI_HID_STAT_BYTES_IN) +
+			spi_hid_stat_sum(shid, SPI_HID_STAT_BYTES_OUT);
+
+	shid->stats_reports_per_sec = div64_u64((reports -
+			shid->stats_rate_reports) * NSEC_PER_SEC, elapsed);
+	shid->stats_bytes_per_sec = div64_u64((bytes -
+			shid->stats_rate_bytes) * NSEC_PER_SEC, elapsed);
+	shid->stats_rate_reports = reports;
+	shid->stats_rate_bytes = bytes;
+	shid->stats_rate_ns = now;
+}
+
+/* Called from the input path with input_lock held */
+static void spi_hid_stats_report(struct spi_hid *shid,
+		struct spi_hid_input_header *header, u8 content_id)
+{
+	struct spi_hid_stats *stats = this_cpu_ptr(shid->stats);
+	u8 type = header->report_type < SPI_HID_STAT_TYPES ?
+			header->report_type : 0;
+
+	stats->count[SPI_HID_STAT_REPORTS]++;
+	stats->count[SPI_HID_STAT_BYTES_IN] += SPI_HID_INPUT_HEADER_LEN +
+			header->report_length;
+	stats->by_type[type]++;
+	if (header->report_type == SPI_HID_REPORT_TYPE_DATA)
+		stats->by_id[content_id]++;
+
+	spi_hid_stats_rate(shid, ktime_get_ns());
+}
+
+/*
+* All counters are summed in one pass under input_lock, so the input
+* path counters and the rates are consistent with each other.
+*/
+static int spi_hid_stats_show(struct seq_file *m, void *v)
+{
+	struct spi_hid *shid = m->private;
+	struct spi_hid_stats *snap;
+	u64 reports_per_sec, bytes_per_sec;
+	unsigned long flags;
+	int cpu, i;
+
+	snap = kzalloc(sizeof(*snap), GFP_KERNEL);
+	if (!snap)
+		return -ENOMEM;
+
+	spin_lock_irqsave(&shid->input_lock, flags);
+	for_each_possible_cpu(cpu) {
+		struct spi_hid_stats *stats = per_cpu_ptr(shid->stats, cpu);
+
+		for (i = 0; i < SPI_HID_STAT_COUNTERS; i++)
+			snap->count[i] += READ_ONCE(stats->count[i]);
+		for (i = 0; i < SPI_HID_STAT_TYPES; i++)
+			snap->by_type[i] += READ_ONCE(stats->by_type[i]);
+		for (i = 0; i < ARRAY_SIZE(snap->by_id); i++)
+			snap->by_id[i] += READ_ONCE(stats->by_id[i]);
+	}
+	spi_hid_stats_rate(shid, ktime_get_ns());
+	reports_per_sec = shid->stats_reports_per_sec;
+	bytes_per_sec = shid->stats_bytes_per_sec;
+	spin_unlock_irqrestore(&shid->input_lock, flags);
+
+	seq_printf(m, "timestamp_ns %llu\n", ktime_get_ns());
+	for (i = 0; i < SPI_HID_STAT_COUNTERS; i++)
+		seq_printf(m, "%s %llu\n", spi_hid_stat_names[i],
+				snap->count[i]);
+	seq_printf(m, "reports_per_sec %llu\n", reports_per_sec);
+	seq_printf(m, "bytes_per_sec %llu\n", bytes_per_sec);
+	for (i = 0; i < SPI_HID_STAT_TYPES; i++)
+		if (snap->by_type[i])
+			seq_printf(m, "type_0x%02x %llu\n", i, snap->by_type[i]);
+	for (i = 0; i < ARRAY_SIZE(snap->by_id); i++)
+		if (snap->by_id[i])
+			seq_printf(m, "id_0x%02x %llu\n", i, snap->by_id[i]);
+
+	kfree(snap);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(spi_hid_stats);
+
+static const char *const spi_hid_lat_names[SPI_HID_LAT_STAGES] = {
+	[SPI_HID_LAT_IRQ_TO_HEADER] = "irq_to_header",
+	[SPI_HID_LAT_HEADER] = "header",
+	[SPI_HID_LAT_HEADER_TO_BODY] = "header_to_body",
+	[SPI_HID_LAT_BODY] = "body",
+	[SPI_HID_LAT_DELIVERY] = "delivery",
+	[SPI_HID_LAT_TOTAL] = "total",
+};
+
+static void spi_hid_lat_record(struct spi_hid *shid, int stage, u64 start_ns,
+		u64 end_ns)
+{
+	int bucket;
+
+	if (!start_ns || end_ns < start_ns)
+		return;
+
+	bucket = min(fls64(end_ns - start_ns), SPI_HID_LAT_BUCKETS - 1);
+	this_cpu_inc(shid->lat_hist->buckets[stage][bucket]);
+}
+
+/* Upper bound in ns of the bucket holding the @permille percentile */
+static u64 spi_hid_lat_percentile(const u64 *buckets, u64 total,
+		unsigned int permille)
+{
+	u64 rank = div_u64(total * permille + 999, 1000);
+	u64 seen = 0;
+	int i;
+
+	for (i = 0; i < SPI_HID_LAT_BUCKETS; i++) {
+		seen += buckets[i];
+		if (seen >= rank)
+			break;
+	}
+
+	return i ? 1ULL << min(i, 63) : 0;
+}
+
+static int spi_hid_latency_hist_show(struct seq_file *m, void *v)
+{
+	struct spi_hid *shid = m->private;
+	u64 buckets[SPI_HID_LAT_BUCKETS];
+	u64 total;
+	int stage, cpu, i;
+
+	seq_printf(m, "%-16s %12s %12s %12s %12s\n", "stage", "count",
+			"p50_ns", "p99_ns", "p999_ns");
+
+	for (stage = 0; stage < SPI_HID_LAT_STAGES; stage++) {
+		memset(buckets, 0, sizeof(buckets));
+		total = 0;
+		for_each_possible_cpu(cpu) {
+			struct spi_hid_lat_hist *hist =
+				per_cpu_ptr(shid->lat_hist, cpu);
+
+			for (i = 0; i < SPI_HID_LAT_BUCKETS; i++)
+				buckets[i] += READ_ONCE(hist->buckets[stage][i]);
+		}
+		for (i = 0; i < SPI_HID_LAT_BUCKETS; i++)
+			total += buckets[i];
+
+		if (!total) {
+			seq_printf(m, "%-16s %12d %12s %12s %12s\n",
+					spi_hid_lat_names[stage], 0, "-", "-", "-");
+			continue;
+		}
+
+		seq_printf(m, "%-16s %12llu %12llu %12llu %12llu\n",
+				spi_hid_lat_names[stage], total,
+				spi_hid_lat_percentile(buckets, total, 500),
+				spi_hid_lat_percentile(buckets, total, 990),
+				spi_hid_lat_percentile(buckets, total, 999));
+
+		for (i = 0; i < SPI_HID_LAT_BUCKETS; i++) {
+			if (!buckets[i])
+				continue;
+			seq_printf(m, "  [%llu, %llu) %llu\n",
+					i ? 1ULL << (i - 1) : 0,
+					1ULL << min(i, 63), buckets[i]);
+		}
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(spi_hid_latency_hist);
+
+/* Called from the input path with input_lock held */
+static void spi_hid_lat_log_add(struct spi_hid *shid, u8 report_id,
+		u16 signature, u64 irq_ns, u64 delivered_ns)
+{
+	struct spi_hid_lat_log_rec *rec;
+
+	spin_lock(&shid->lat_log_lock);
+	if (!shid->lat_log)
+		goto out;
+
+	rec = &shid->lat_log[shid->lat_log_head & (shid->lat_log_depth - 1)];
+	rec->seq = shid->lat_log_head;
+	rec->irq_ns = irq_ns;
+	rec->delivered_ns = delivered_ns;
+	rec->signature = signature;
+	rec->report_id = report_id;
+
+	if (++shid->lat_log_head - shid->lat_log_tail > shid->lat_log_depth) {
+		shid->lat_log_tail++;
+		shid->lat_log_dropped++;
+	}
+
+out:
+	spin_unlock(&shid->lat_log_lock);
+}
+
+/*
+* The seq_file position is the record sequence number, so a reader that
+* keeps its file open tails the log across reads. lat_log_lock is held
+* from start to stop.
+*/
+static void *spi_hid_lat_log_start(struct seq_file *m, loff_t *pos)
+{
+	struct spi_hid *shid = m->private;
+
+	spin_lock_irq(&shid->lat_log_lock);
+
+	if (*pos < shid->lat_log_tail)
+		*pos = shid->lat_log_tail;
+	if (!shid->lat_log || *pos >= shid->lat_log_head)
+		return NULL;
+
+	return &shid->lat_log[*pos & (shid->lat_log_depth - 1)];
+}
+
+static void *spi_hid_lat_log_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	struct spi_hid *shid = m->private;
+
+	if (++*pos >= shid->lat_log_head)
+		return NULL;
+
+	return &shid->lat_log[*pos & (shid->lat_log_depth - 1)];
+}
+
+static void spi_hid_lat_log_stop(struct seq_file *m, void *v)
+{
+	struct spi_hid *shid = m->private;
+
+	/* m->index is the first record not yet copied to the seq buffer */
+	if (shid->lat_log_consume && m->index > shid->lat_log_tail)
+		shid->lat_log_tail = min_t(u64, m->index, shid->lat_log_head);
+
+	spin_unlock_irq(&shid->lat_log_lock);
+}
+
+static int spi_hid_lat_log_show(struct seq_file *m, void *v)
+{
+	struct spi_hid_lat_log_rec *rec = v;
+
+	seq_printf(m, "%llu %u %u %llu %llu\n", rec->seq, rec->report_id,
+			rec->signature, rec->irq_ns, rec->delivered_ns);
+
+	return 0;
+}
+
+static int spi_hid_lat_log_bin_show(struct seq_file *m, void *v)
+{
+	seq_write(m, v, sizeof(struct spi_hid_lat_log_rec));
+
+	return 0;
+}
+
+static const struct seq_operations spi_hid_lat_log_sops = {
+	.start = spi_hid_lat_log_start,
+	.next = spi_hid_lat_log_next,
+	.stop = spi_hid_lat_log_stop,
+	.show = spi_hid_lat_log_show,
+};
+DEFINE_SEQ_ATTRIBUTE(spi_hid_lat_log);
+
+static const struct seq_operations spi_hid_lat_log_bin_sops = {
+	.start = spi_hid_lat_log_start,
+	.next = spi_hid_lat_log_next,
+	.stop = spi_hid_lat_log_stop,
+	.show = spi_hid_lat_log_bin_show,
+};
+DEFINE_SEQ_ATTRIBUTE(spi_hid_lat_log_bin);
+
+static int spi_hid_lat_log_depth_get(void *data, u64 *val)
+{
+	struct spi_hid *shid = data;
+
+	*val = shid->lat_log_depth;
+
+	return 0;
+}
+
+/* Resizing drops the logged records, 0 turns the log off */
+static int spi_hid_lat_log_depth_set(void *data, u64 val)
+{
+	struct spi_hid *shid = data;
+	struct spi_hid_lat_log_rec *log = NULL, *old;
+
+	if (val > SPI_HID_LAT_LOG_MAX_DEPTH)
+		return -EINVAL;
+
+	if (val) {
+		val = roundup_pow_of_two(val);
+		log = kvcalloc(val, sizeof(*log), GFP_KERNEL);
+		if (!log)
+			return -ENOMEM;
+	}
+
+	spin_lock_irq(&shid->lat_log_lock);
+	old = shid->lat_log;
+	shid->lat_log = log;
+	shid->lat_log_depth = val;
+	shid->lat_log_tail = shid->lat_log_head;
+	spin_unlock_irq(&shid->lat_log_lock);
+
+	kvfree(old);
+
+	return 0;
+}
+DEFINE_DEBUGFS_ATTRIBUTE(spi_hid_lat_log_depth_fops, spi_hid_lat_log_depth_get,
+		spi_hid_lat_log_depth_set, "%llu\n");
+
+/*
+* Appends one record to the capture relay channel. Callable from any
+* context, records that do not fit the free sub-buffers are dropped.
+*/
+static void spi_hid_capture(struct spi_hid *shid, u8 type, const void *hdr,
+		u16 hdr_len, const void *body, u32 body_len)
+{
+	struct spi_hid_cap_rec *rec;
+	unsigned long flags;
+	u32 len = hdr_len + body_len;
+	u32 size = SPI_HID_CAP_REC_SIZE(len);
+
+	if (!READ_ONCE(shid->capture_on))
+		return;
+
+	spin_lock_irqsave(&shid->capture_lock, flags);
+	if (!shid->capture_on)
+		goto out;
+
+	rec = relay_reserve(shid->capture, size);
+	if (!rec) {
+		shid->capture_dropped++;
+		goto out;
+	}
+
+	rec->magic = SPI_HID_CAP_MAGIC;
+	rec->size = size;
+	rec->seq = shid->capture_seq++;
+	rec->ts_ns = ktime_get_ns();
+	rec->type = type;
+	rec->version = SPI_HID_CAP_VERSION;
+	rec->hdr_len = hdr_len;
+	rec->len = len;
+	memcpy(rec->data, hdr, hdr_len);
+	if (body_len)
+		memcpy(rec->data + hdr_len, body, body_len);
+	memset(rec->data + len, 0, size - sizeof(*rec) - len);
+
+out:
+	spin_unlock_irqrestore(&shid->capture_lock, flags);
+}
+
+static struct dentry *spi_hid_capture_create_buf_file(const char *filename,
+		struct dentry *parent, umode_t mode, struct rchan_buf *buf,
+		int *is_global)
+{
+	return debugfs_create_file(filename, mode, parent, buf,
+			&relay_file_operations);
+}
+
+static int spi_hid_capture_remove_buf_file(struct dentry *dentry)
+{
+	debugfs_remove(dentry);
+
+	return 0;
+}
+
+static const struct rchan_callbacks spi_hid_capture_callbacks = {
+	.create_buf_file = spi_hid_capture_create_buf_file,
+	.remove_buf_file = spi_hid_capture_remove_buf_file,
+};
+
+static int spi_hid_capture_enable_get(void *data, u64 *val)
+{
+	struct spi_hid *shid = data;
+
+	*val = shid->capture_on;
+
+	return 0;
+}
+
+/*
+* The relay channel is created on the first start and kept until remove,
+* so a stopped capture can still be read. Restarting resets the buffers.
+*/
+static int spi_hid_capture_enable_set(void *data, u64 val)
+{
+	struct spi_hid *shid = data;
+	struct spi_hid_cap_start start = {
+		.vendor_id = shid->desc.vendor_id,
+		.product_id = shid->desc.product_id,
+		.version_id = shid->desc.version_id,
+		.hid_version = shid->desc.hid_version,
+		.max_input_length = shid->desc.max_input_length,
+		.max_output_length = shid->desc.max_output_length,
+	};
+	int ret = 0;
+
+	mutex_lock(&shid->capture_mutex);
+
+	if (!val) {
+		spin_lock_irq(&shid->capture_lock);
+		shid->capture_on = false;
+		spin_unlock_irq(&shid->capture_lock);
+		if (shid->capture)
+			relay_flush(shid->capture);
+		goto out;
+	}
+
+	if (shid->capture_on)
+		goto out;
+
+	if (!shid->capture) {
+		shid->capture = relay_open("capture", shid->debugfs,
+				SPI_HID_CAP_SUBBUF_SIZE, SPI_HID_CAP_SUBBUFS,
+				&spi_hid_capture_callbacks, shid);
+		if (!shid->capture) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	} else {
+		relay_reset(shid->capture);
+	}
+
+	spin_lock_irq(&shid->capture_lock);
+	shid->capture_seq = 0;
+	shid->capture_dropped = 0;
+	shid->capture_on = true;
+	spin_unlock_irq(&shid->capture_lock);
+
+	spi_hid_capture(shid, SPI_HID_CAP_START, &start, sizeof(start), NULL, 0);
+
+out:
+	mutex_unlock(&shid->capture_mutex);
+
+	return ret;
+}
+DEFINE_DEBUGFS_ATTRIBUTE(spi_hid_capture_enable_fops,
+		spi_hid_capture_enable_get, spi_hid_capture_enable_set, "%llu\n");
+
 static void spi_hid_parse_dev_desc(struct spi_hid_device_desc_raw *raw,
 		struct spi_hid_device_descriptor *desc)
 {
+	u16 flags = le16_to_cpu(raw->wFlags);
+
 	desc->hid_version = le16_to_cpu(raw->bcdVersion);
 	desc->report_descriptor_length = le16_to_cpu(raw->wReportDescLength);
 	desc->report_descriptor_register =
@@ -101,8 +720,16 @@ static void spi_hid_parse_dev_desc(struct spi_hid_device_desc_raw *raw,
 	desc->vendor_id = le16_to_cpu(raw->wVendorID);
 	desc->product_id = le16_to_cpu(raw->wProductID);
 	desc->version_id = le16_to_cpu(raw->wVersionID);
-	desc->device_power_support = 0;
-	desc->power_response_delay = 0;
+	desc->device_power_support =
+		flags & SPI_HID_DEV_DESC_POWER_SUPPORT_MASK;
+	desc->power_response_delay =
+		flags >> SPI_HID_DEV_DESC_POWER_DELAY_SHIFT;
+
+	/*
+	* A device that does not report power support only gets powered off
+	*/
+	if (!desc->device_power_support)
+		desc->device_power_support = SPI_HID_POWER_SUPPORT_NONE;
 }
 
 static void spi_hid_populate_input_header(__u8 *buf,
@@ -138,6 +765,17 @@ static void spi_hid_input_report_prepare(struct spi_hid_input_buf *buf,
 	report->content = buf->content;
 }
 
+/* The sample counter is shared by inputs and outputs without locking */
+static bool spi_hid_trace_sample(struct spi_hid *shid)
+{
+	u32 n = READ_ONCE(shid->trace_sample);
+
+	if (n <= 1)
+		return n;
+
+	return ++shid->trace_sample_count % n == 0;
+}
+
 static void spi_hid_output_header(__u8 *buf,
 		u16 output_register, u16 output_report_length)
 {
@@ -181,6 +819,9 @@ static int spi_hid_input_async(struct spi_hid *shid, void *buf, u16 length,
 	shid->input_transfer[1].rx_buf = buf;
 	shid->input_transfer[1].len = length;
 
+	shid->input_transfer[0].speed_hz = READ_ONCE(shid->xfer_speed_hz);
+	shid->input_transfer[1].speed_hz = shid->input_transfer[0].speed_hz;
+
 	/*
 	 * Optimization opportunity: we really do not need the input_register
 	 * field in struct spi_hid; we can calculate the read_approval field
@@ -198,16 +839,25 @@ static int spi_hid_input_async(struct spi_hid *shid, void *buf, u16 length,
 
 	shid->input_message.complete = complete;
 	shid->input_message.context = shid;
-
-	trace_spi_hid_input_async(shid,
-			shid->input_transfer[0].tx_buf,
-			shid->input_transfer[0].len,
-			shid->input_transfer[1].rx_buf,
-			shid->input_transfer[1].len, 0);
+	shid->lat_submit_ns = ktime_get_ns();
+
+	/* A header read starts a new frame, the body follows its decision */
+	if (buf == shid->input.header)
+		shid->trace_payload = spi_hid_trace_sample(shid);
+
+	trace_spi_hid_input_async_hdr(shid, shid->input_transfer[0].len,
+			length, buf == shid->input.header ? 0 :
+			(shid->input.header[0] >> 4) & 0xf, 0, 0);
+	if (shid->trace_payload)
+		trace_spi_hid_input_async(shid,
+				shid->input_transfer[0].tx_buf,
+				shid->input_transfer[0].len,
+				shid->input_transfer[1].rx_buf,
+				shid->input_transfer[1].len, 0);
 
 	ret = spi_async(shid->spi, &shid->input_message);
 	if (ret) {
-		shid->bus_error_count++;
+		spi_hid_stat_inc(shid, SPI_HID_STAT_BUS_ERRORS);
 		shid->bus_last_error = ret;
 	}
 
@@ -217,17 +867,19 @@ static int spi_hid_input_async(struct spi_hid *shid, void *buf, u16 length,
 static void spi_hid_output_complete(void *context)
 {
 	struct spi_hid *shid = context;
-	struct device *dev = &shid->spi->dev;
-	
-	/* Simple completion callback - just log success */
-	dev_info(dev, "MSHW0231: Async SPI output completed successfully\n");
+
+	/* The message and buffer are free before the waiter wakes up */
+	smp_store_release(&shid->output_inflight, false);
 	complete(&shid->output_done);
 }
 
 static int spi_hid_output(struct spi_hid *shid, void *buf, u16 length)
 {
-	struct spi_transfer transfer;
-	struct spi_message message;
+	struct spi_transfer *transfer = &shid->output_transfer;
+	struct spi_message *message = &shid->output_message;
+	unsigned long left;
+	u8 type = 0, id = 0;
+	bool payload;
 	int ret;
 
 	/* Check if we're in atomic context */
@@ -239,29 +891,72 @@ static int spi_hid_output(struct spi_hid *shid, void *buf, u16 length)
 		return 0;
 	}
 
-	memset(&transfer, 0, sizeof(transfer));
+	/* A timed out transfer still owns the message and output buffer */
+	if (smp_load_acquire(&shid->output_inflight))
+		return -EBUSY;
 
-	transfer.tx_buf = buf;
-	transfer.len = length;
+	memset(transfer, 0, sizeof(*transfer));
 
-	spi_message_init_with_transfers(&message, &transfer, 1);
-	message.complete = spi_hid_output_complete;
-	message.context = shid;
+	transfer->tx_buf = buf;
+	transfer->len = length;
+	transfer->speed_hz = READ_ONCE(shid->xfer_speed_hz);
+
+	spi_message_init_with_transfers(message, transfer, 1);
+	message->complete = spi_hid_output_complete;
+	message->context = shid;
 
 	/*
 	 * Use asynchronous operation to prevent scheduling while atomic
 	 * This addresses the critical crash issue when called from SPI completion callbacks
 	 */
-	trace_spi_hid_output_begin(shid, transfer.tx_buf,
-			transfer.len, NULL, 0, 0);
+	if (length >= SPI_HID_OUTPUT_HEADER_LEN + SPI_HID_OUTPUT_BODY_LEN) {
+		type = ((u8 *)buf)[SPI_HID_OUTPUT_HEADER_LEN];
+		id = ((u8 *)buf)[SPI_HID_OUTPUT_HEADER_LEN + 3];
+	}
+	payload = spi_hid_trace_sample(shid);
 
-	ret = spi_async(shid->spi, &message);
+	spi_hid_capture(shid, SPI_HID_CAP_OUTPUT, buf,
+			min_t(u16, length, SPI_HID_OUTPUT_HEADER_LEN),
+			buf + min_t(u16, length, SPI_HID_OUTPUT_HEADER_LEN),
+			length - min_t(u16, length, SPI_HID_OUTPUT_HEADER_LEN));
 
-	trace_spi_hid_output_end(shid, transfer.tx_buf,
-			transfer.len, NULL, 0, ret);
+	trace_spi_hid_output_begin_hdr(shid, length, 0, type, id, 0);
+	if (payload)
+		trace_spi_hid_output_begin(shid, transfer->tx_buf,
+				transfer->len, NULL, 0, 0);
 
+	reinit_completion(&shid->output_done);
+	WRITE_ONCE(shid->output_inflight, true);
+	ret = spi_async(shid->spi, message);
+
+	/*
+	* The message lives in shid and the output buffer stays valid, so a
+	* lost completion only fails this output. Later outputs are refused
+	* until the controller gives the message back. The late completion
+	* of a timed out output can still wake us, so only our own cleared
+	* output_inflight ends the wait.
+	*/
 	if (ret) {
-		shid->bus_error_count++;
+		WRITE_ONCE(shid->output_inflight, false);
+	} else {
+		left = msecs_to_jiffies(SPI_HID_OUTPUT_TIMEOUT_MS);
+		do {
+			left = wait_for_completion_timeout(&shid->output_done,
+					left);
+		} while (left && smp_load_acquire(&shid->output_inflight));
+		ret = left ? message->status : -ETIMEDOUT;
+	}
+
+	trace_spi_hid_output_end_hdr(shid, length, 0, type, id, ret);
+	if (payload)
+		trace_spi_hid_output_end(shid, transfer->tx_buf,
+				transfer->len, NULL, 0, ret);
+
+	if (!ret) {
+		spi_hid_stat_inc(shid, SPI_HID_STAT_OUTPUTS);
+		spi_hid_stat_add(shid, SPI_HID_STAT_BYTES_OUT, length);
+	} else {
+		spi_hid_stat_inc(shid, SPI_HID_STAT_BUS_ERRORS);
 		shid->bus_last_error = ret;
 	}
 
@@ -324,31 +1019,137 @@ static void spi_hid_stop_hid(struct spi_hid *shid)
 	if (hid) {
 		cancel_work_sync(&shid->create_device_work);
 		cancel_work_sync(&shid->refresh_device_work);
+		cancel_work_sync(&shid->desc_validate_work);
 		hid_destroy_device(hid);
 	}
 }
 
-static int spi_hid_reset_via_acpi(struct spi_hid *shid)
+static const char *const spi_hid_reset_phase_names[SPI_HID_RESET_PHASES] = {
+	[SPI_HID_RESET_PHASE_BACKOFF] = "backoff",
+	[SPI_HID_RESET_PHASE_ASSERT] = "assert",
+	[SPI_HID_RESET_PHASE_RESPONSE] = "response",
+	[SPI_HID_RESET_PHASE_DESCRIPTOR] = "descriptor",
+	[SPI_HID_RESET_PHASE_READY] = "ready",
+};
+
+static void spi_hid_reset_timing_start(struct spi_hid *shid)
 {
-	acpi_handle handle = ACPI_HANDLE(&shid->spi->dev);
-	acpi_status status;
-	struct device *dev = &shid->spi->dev;
+	memset(shid->reset_phase_last_us, 0, sizeof(shid->reset_phase_last_us));
+	shid->reset_phase_start = ktime_get();
+	shid->reset_timing_active = true;
+}
 
-	/* MSHW0231 specific GPIO reset sequence */
-	if (acpi_dev_hid_uid_match(ACPI_COMPANION(dev), "MSHW0231", NULL)) {
-		struct gpio_desc *reset_gpio;
-		
-		dev_info(dev, "MSHW0231: Attempting GPIO reset on pin 132\n");
-		
-		/* Try to get GPIO 132 for reset */
-		reset_gpio = gpio_to_desc(644); /* GPIO 132 + 512 offset = 644 */
-		if (!reset_gpio) {
-			dev_warn(dev, "MSHW0231: Could not get GPIO 132 descriptor, trying ACPI reset\n");
-			goto acpi_reset;
-		}
-		
-		/* Request GPIO for reset */
-		if (gpio_request(644, "mshw0231-reset") != 0) {
+/*
+* Records the time spent in @phase, which ended at @now, and starts the next
+* one. Marks outside of a timed reset, such as a spontaneous FW reset, and
+* stamps left over from an earlier reset are ignored. Only called from
+* process context; the input path just stamps reset_response_time and
+* reset_desc_time.
+*/
+static void spi_hid_reset_mark_at(struct spi_hid *shid, int phase,
+		ktime_t now)
+{
+	u64 delta;
+
+	if (!shid->reset_timing_active ||
+		ktime_before(now, shid->reset_phase_start))
+		return;
+
+	delta = ktime_us_delta(now, shid->reset_phase_start);
+	shid->reset_phase_last_us[phase] = delta;
+	shid->reset_phase_max_us[phase] = max(shid->reset_phase_max_us[phase],
+			delta);
+	shid->reset_phase_start = now;
+
+	if (phase == SPI_HID_RESET_PHASE_READY) {
+		shid->reset_timing_active = false;
+		shid->reset_timing_count++;
+	}
+}
+
+static void spi_hid_reset_mark(struct spi_hid *shid, int phase)
+{
+	spi_hid_reset_mark_at(shid, phase, ktime_get());
+}
+
+/*
+* The reset response report is the device's own signal that it is back, so
+* wait for that instead of the worst case settle time. Must be called
+* without power_lock held, the reset work may need it meanwhile.
+*/
+static void spi_hid_wait_for_reset_response(struct spi_hid *shid)
+{
+	struct device *dev = &shid->spi->dev;
+
+	if (!wait_for_completion_timeout(&shid->reset_response,
+			msecs_to_jiffies(SPI_HID_RESET_RESPONSE_TIMEOUT_MS))) {
+		dev_warn(dev, "no reset response within %d ms\n",
+				SPI_HID_RESET_RESPONSE_TIMEOUT_MS);
+		return;
+	}
+
+	mutex_lock(&shid->power_lock);
+	spi_hid_reset_mark_at(shid, SPI_HID_RESET_PHASE_RESPONSE,
+			shid->reset_response_time);
+	mutex_unlock(&shid->power_lock);
+}
+
+/*
+* Devices described by a software node, such as spi-hid-sim, have no _RST.
+* They are reset through an optional "reset" GPIO, held asserted for a
+* millisecond; without one the device has to send its reset response on
+* its own.
+*/
+static int spi_hid_reset_via_gpio(struct spi_hid *shid)
+{
+	struct device *dev = &shid->spi->dev;
+	struct gpio_desc *reset_gpio;
+
+	reset_gpio = gpiod_get_optional(dev, "reset", GPIOD_OUT_HIGH);
+	if (IS_ERR(reset_gpio))
+		return PTR_ERR(reset_gpio);
+
+	if (reset_gpio) {
+		usleep_range(1000, 2000);
+		gpiod_set_value_cansleep(reset_gpio, 0);
+		gpiod_put(reset_gpio);
+	}
+
+	spi_hid_reset_mark(shid, SPI_HID_RESET_PHASE_ASSERT);
+
+	return 0;
+}
+
+/*
+* Arms reset_response before resetting the device, callers wait for it
+* with spi_hid_wait_for_reset_response() once they dropped power_lock.
+*/
+static int spi_hid_reset_via_acpi(struct spi_hid *shid)
+{
+	acpi_handle handle = ACPI_HANDLE(&shid->spi->dev);
+	acpi_status status;
+	struct device *dev = &shid->spi->dev;
+
+	reinit_completion(&shid->reset_response);
+
+	if (!has_acpi_companion(dev))
+		return spi_hid_reset_via_gpio(shid);
+
+	/* MSHW0231 specific GPIO reset sequence */
+	if (acpi_dev_hid_uid_match(ACPI_COMPANION(dev), "MSHW0231", NULL)) {
+		struct gpio_desc *reset_gpio;
+		
+		dev_info(dev, "MSHW0231: Attempting GPIO reset on pin 132\n");
+		
+		/* Try to get GPIO 132 for reset */
+		reset_gpio = gpio_to_desc(644); /* GPIO 132 + 512 offset = 644 */
+		if (!reset_gpio) {
+			dev_warn(dev, "MSHW0231: Could not get GPIO 132 descriptor, trying ACPI reset\n");
+			goto acpi_reset;
+		}
+		
+		/* Request GPIO for reset */
+		if (gpio_request(644, "mshw0231-reset") != 0) {
 			dev_warn(dev, "MSHW0231: Could not request GPIO 132, trying ACPI reset\n");
 			goto acpi_reset;
 		}
@@ -366,9 +1167,7 @@ static int spi_hid_reset_via_acpi(struct spi_hid *shid)
 		gpio_set_value(644, 0); /* Assert reset (low) */
 		msleep(100); /* Hold reset longer like Windows */
 		gpio_set_value(644, 1); /* Deassert reset (high) */
-		msleep(1000); /* Wait much longer for full Windows-style init */
-		
-		dev_info(dev, "MSHW0231: Extended Windows-style initialization complete\n");
+		spi_hid_reset_mark(shid, SPI_HID_RESET_PHASE_ASSERT);
 		
 		gpio_free(644);
 		dev_info(dev, "MSHW0231: GPIO reset sequence completed\n");
@@ -380,12 +1179,41 @@ acpi_reset:
 	if (ACPI_FAILURE(status))
 		return -EFAULT;
 
+	spi_hid_reset_mark(shid, SPI_HID_RESET_PHASE_ASSERT);
+
 	return 0;
 }
 
+static void spi_hid_reset_budget_decay(struct spi_hid *shid)
+{
+	unsigned long period = msecs_to_jiffies(SPI_HID_RESET_BUDGET_DECAY_MS);
+	unsigned long regained = (jiffies - shid->last_reset_attempt) / period;
+
+	shid->attempts -= min_t(unsigned long, regained, shid->attempts);
+}
+
+/*
+* Exponential backoff with jitter between consecutive reset attempts. The
+* first attempt is not delayed, and SPI_HID_MAX_RESET_ATTEMPTS bounds the
+* longest one.
+*/
+static unsigned int spi_hid_reset_backoff_ms(struct spi_hid *shid)
+{
+	unsigned int backoff;
+
+	if (shid->attempts <= 1)
+		return 0;
+
+	backoff = SPI_HID_RESET_BACKOFF_BASE_MS << (shid->attempts - 2);
+
+	return backoff + get_random_u32_below(backoff / 2 + 1);
+}
+
 static int spi_hid_error_handler(struct spi_hid *shid)
 {
 	struct device *dev = &shid->spi->dev;
+	bool reset_issued = false;
+	unsigned int backoff;
 	int ret = 0;
 
 	mutex_lock(&shid->power_lock);
@@ -394,6 +1222,7 @@ static int spi_hid_error_handler(struct spi_hid *shid)
 
 	dev_err(dev, "Error Handler\n");
 
+	spi_hid_reset_budget_decay(shid);
 	if (shid->attempts++ >= SPI_HID_MAX_RESET_ATTEMPTS) {
 		dev_err(dev, "unresponsive device, aborting.\n");
 		spi_hid_stop_hid(shid);
@@ -402,6 +1231,16 @@ static int spi_hid_error_handler(struct spi_hid *shid)
 		ret = -ESHUTDOWN;
 		goto out;
 	}
+	shid->last_reset_attempt = jiffies;
+
+	spi_hid_reset_timing_start(shid);
+	backoff = spi_hid_reset_backoff_ms(shid);
+	if (backoff) {
+		dev_err(dev, "reset attempt %u, backing off %u ms\n",
+				shid->attempts, backoff);
+		msleep(backoff);
+	}
+	spi_hid_reset_mark(shid, SPI_HID_RESET_PHASE_BACKOFF);
 
 	shid->ready = false;
 	sysfs_notify(&dev->kobj, NULL, "ready");
@@ -427,11 +1266,13 @@ static int spi_hid_error_handler(struct spi_hid *shid)
 	shid->power_state = SPI_HID_POWER_MODE_ACTIVE;
 
 	if (dev->of_node) {
+		reinit_completion(&shid->reset_response);
 		ret = pinctrl_select_state(shid->pinctrl, shid->pinctrl_active);
 		if (ret) {
 			dev_err(dev, "Power Restart failed\n");
 			goto out;
 		}
+		spi_hid_reset_mark(shid, SPI_HID_RESET_PHASE_ASSERT);
 	} else {
 		ret = spi_hid_reset_via_acpi(shid);
 		if (ret) {
@@ -439,6 +1280,132 @@ static int spi_hid_error_handler(struct spi_hid *shid)
 			goto out;
 		}
 	}
+	reset_issued = true;
+
+out:
+	mutex_unlock(&shid->power_lock);
+
+	/* Full init, bounded by the reset response */
+	if (reset_issued)
+		spi_hid_wait_for_reset_response(shid);
+
+	return ret;
+}
+
+static int spi_hid_device_descriptor_request(struct spi_hid *shid)
+{
+	struct spi_hid_output_buf *buf = &shid->output;
+	int ret;
+
+	mutex_lock(&shid->lock);
+	memset(&buf->body, 0x00, SPI_HID_OUTPUT_BODY_LEN);
+	spi_hid_output_header(buf->header, shid->hid_desc_addr,
+			round_up(sizeof(buf->body), 4));
+	ret =  spi_hid_output(shid, buf, SPI_HID_OUTPUT_HEADER_LEN +
+			SPI_HID_OUTPUT_BODY_LEN);
+	mutex_unlock(&shid->lock);
+
+	return ret;
+}
+
+/*
+* Picks the next step of the recovery ladder, starting no lower than
+* @min_step. Errors raised while a queued step is still pending are
+* coalesced into it, and the ladder starts over once no error has been seen
+* for SPI_HID_RECOVERY_WINDOW_MS.
+*/
+static u8 spi_hid_recovery_escalate(struct spi_hid *shid, u8 min_step)
+{
+	unsigned long now = jiffies;
+	unsigned long flags;
+	u8 step;
+
+	spin_lock_irqsave(&shid->recovery_lock, flags);
+
+	if (shid->recovery_pending) {
+		shid->recovery_coalesced++;
+		step = SPI_HID_RECOVERY_NONE;
+		goto out;
+	}
+
+	if (time_after(now, shid->recovery_last +
+			msecs_to_jiffies(SPI_HID_RECOVERY_WINDOW_MS)))
+		shid->recovery_step = SPI_HID_RECOVERY_NONE;
+
+	step = max_t(u8, shid->recovery_step + 1, min_step);
+	step = min_t(u8, step, SPI_HID_RECOVERY_HARD_RESET);
+
+	shid->recovery_step = step;
+	shid->recovery_last = now;
+	shid->recovery_count[step]++;
+	if (step > SPI_HID_RECOVERY_RESYNC)
+		shid->recovery_pending = true;
+
+out:
+	spin_unlock_irqrestore(&shid->recovery_lock, flags);
+
+	return step;
+}
+
+static bool spi_hid_queue_work(struct spi_hid *shid, struct work_struct *work)
+{
+	return queue_work(shid->wq, work);
+}
+
+/*
+* Device work runs on an unbound workqueue, so the CPUs it may run on are a
+* workqueue attribute rather than a choice made at queue time. Keeps the
+* high priority that WQ_HIGHPRI gave at allocation.
+*/
+static int spi_hid_wq_set_cpus(struct spi_hid *shid,
+		const struct cpumask *cpus)
+{
+	struct workqueue_attrs *attrs;
+	int ret;
+
+	attrs = alloc_workqueue_attrs();
+	if (!attrs)
+		return -ENOMEM;
+
+	attrs->nice = MIN_NICE;
+	cpumask_copy(attrs->cpumask, cpus);
+	ret = apply_workqueue_attrs(shid->wq, attrs);
+	free_workqueue_attrs(attrs);
+
+	return ret;
+}
+
+/*
+* Entry point for every error that needs recovery. Steps above RESYNC are
+* run from error_work; RESYNC is returned to the input path, which is the
+* only caller that asks for it and performs it itself.
+*/
+static u8 spi_hid_schedule_recovery(struct spi_hid *shid, u8 min_step)
+{
+	u8 step = spi_hid_recovery_escalate(shid, min_step);
+
+	if (step > SPI_HID_RECOVERY_RESYNC)
+		spi_hid_queue_work(shid, &shid->error_work);
+
+	return step;
+}
+
+/*
+* Re-runs the device descriptor handshake without touching the reset line.
+* The descriptor response refreshes the HID device as after a FW reset.
+*/
+static int spi_hid_protocol_reset(struct spi_hid *shid)
+{
+	struct device *dev = &shid->spi->dev;
+	int ret = 0;
+
+	mutex_lock(&shid->power_lock);
+	if (shid->power_state == SPI_HID_POWER_MODE_OFF)
+		goto out;
+
+	dev_err(dev, "Protocol reset\n");
+
+	ret = spi_hid_device_descriptor_request(shid);
 
 out:
 	mutex_unlock(&shid->power_lock);
@@ -449,11 +1416,126 @@ static void spi_hid_error_work(struct work_struct *work)
 {
 	struct spi_hid *shid = container_of(work, struct spi_hid, error_work);
 	struct device *dev = &shid->spi->dev;
+	unsigned long flags;
+	u8 step;
 	int ret;
 
+	spin_lock_irqsave(&shid->recovery_lock, flags);
+	step = shid->recovery_step;
+	spin_unlock_irqrestore(&shid->recovery_lock, flags);
+
+	if (step == SPI_HID_RECOVERY_PROTOCOL_RESET) {
+		ret = spi_hid_protocol_reset(shid);
+		if (!ret)
+			goto out;
+
+		dev_err(dev, "%s: protocol reset failed, escalating\n",
+				__func__);
+
+		spin_lock_irqsave(&shid->recovery_lock, flags);
+		shid->recovery_step = SPI_HID_RECOVERY_HARD_RESET;
+		shid->recovery_count[SPI_HID_RECOVERY_HARD_RESET]++;
+		spin_unlock_irqrestore(&shid->recovery_lock, flags);
+	}
+
 	ret = spi_hid_error_handler(shid);
 	if (ret)
 		dev_err(dev, "%s: error handler failed\n", __func__);
+
+out:
+	spin_lock_irqsave(&shid->recovery_lock, flags);
+	shid->recovery_pending = false;
+	spin_unlock_irqrestore(&shid->recovery_lock, flags);
+}
+
+/*
+* Counts and latches an alarm, safe from atomic context. Logging, the sysfs
+* notification and recovery can sleep and are left to wd_alarm_work.
+*/
+static void spi_hid_wd_alarm(struct spi_hid *shid, u8 reason, u64 value)
+{
+	shid->wd_alarms[reason]++;
+	trace_spi_hid_watchdog(shid, reason, value);
+
+	WRITE_ONCE(shid->wd_alarm_value[reason], value);
+	set_bit(reason, &shid->wd_alarm_pending);
+	spi_hid_queue_work(shid, &shid->wd_alarm_work);
+}
+
+static void spi_hid_wd_alarm_work(struct work_struct *work)
+{
+	struct spi_hid *shid =
+		container_of(work, struct spi_hid, wd_alarm_work);
+	struct device *dev = &shid->spi->dev;
+	bool recover = false;
+	u8 reason;
+
+	for (reason = 0; reason < SPI_HID_WD_REASONS; reason++) {
+		if (!test_and_clear_bit(reason, &shid->wd_alarm_pending))
+			continue;
+
+		dev_err(dev, "%s: %s %llu %s\n", __func__,
+				reason == SPI_HID_WD_STALL ? "no heartbeat for" :
+				"latency over SLO,",
+				READ_ONCE(shid->wd_alarm_value[reason]),
+				reason == SPI_HID_WD_STALL ? "ms" : "us");
+		recover = true;
+	}
+
+	if (!recover)
+		return;
+
+	sysfs_notify(&dev->kobj, NULL, "spi_hid_watchdog");
+
+	if (shid->wd_recover)
+		spi_hid_schedule_recovery(shid,
+				SPI_HID_RECOVERY_PROTOCOL_RESET);
+}
+
+static void spi_hid_wd_work(struct work_struct *work)
+{
+	struct spi_hid *shid =
+		container_of(to_delayed_work(work), struct spi_hid, wd_work);
+
+	/* Heartbeats are expected to stop while the device is not running */
+	if (!shid->ready || shid->power_state != SPI_HID_POWER_MODE_ACTIVE ||
+			shid->idle_sleeping)
+		return;
+
+	spi_hid_wd_alarm(shid, SPI_HID_WD_STALL,
+			div_u64(ktime_get_ns() - shid->wd_hb_last_ns,
+				NSEC_PER_MSEC));
+}
+
+/* Called from the input path with input_lock held */
+static void spi_hid_wd_heartbeat(struct spi_hid *shid)
+{
+	u64 now = ktime_get_ns();
+
+	if (shid->wd_hb_last_ns)
+		shid->wd_hb_interval_ms = div_u64(now - shid->wd_hb_last_ns,
+				NSEC_PER_MSEC);
+	shid->wd_hb_last_ns = now;
+	shid->wd_heartbeats++;
+
+	if (shid->wd_timeout_ms)
+		mod_delayed_work(shid->wq, &shid->wd_work,
+				msecs_to_jiffies(shid->wd_timeout_ms));
+}
+
+/* Called from the input path with input_lock held */
+static void spi_hid_wd_latency(struct spi_hid *shid, u64 latency_ns)
+{
+	u64 latency_us = div_u64(latency_ns, NSEC_PER_USEC);
+
+	if (!shid->wd_slo_us || latency_us <= shid->wd_slo_us) {
+		shid->wd_slo_streak = 0;
+		return;
+	}
+
+	/* One alarm per streak */
+	if (++shid->wd_slo_streak == shid->wd_slo_frames)
+		spi_hid_wd_alarm(shid, SPI_HID_WD_SLO, latency_us);
 }
 
 /**
@@ -466,7 +1548,6 @@ static void spi_hid_reset_work(struct work_struct *work)
 	struct spi_hid *shid =
 		container_of(work, struct spi_hid, reset_work);
 	struct device *dev = &shid->spi->dev;
-	struct spi_hid_output_buf *buf = &shid->output;
 	int ret;
 
 	trace_spi_hid_reset_work(shid);
@@ -475,7 +1556,7 @@ static void spi_hid_reset_work(struct work_struct *work)
 	if (shid->ready) {
 		dev_err(dev, "Spontaneous FW reset!");
 		shid->ready = false;
-		shid->dir_count++;
+		spi_hid_stat_inc(shid, SPI_HID_STAT_DEVICE_RESETS);
 		sysfs_notify(&dev->kobj, NULL, "ready");
 	}
 
@@ -489,78 +1570,419 @@ static void spi_hid_reset_work(struct work_struct *work)
 	if (flush_work(&shid->refresh_device_work))
 		dev_err(dev, "Reset handler waited for refresh_device_work");
 
-	memset(&buf->body, 0x00, SPI_HID_OUTPUT_BODY_LEN);
-	spi_hid_output_header(buf->header, shid->hid_desc_addr,
-			round_up(sizeof(buf->body), 4));
-	ret =  spi_hid_output(shid, buf, SPI_HID_OUTPUT_HEADER_LEN +
-			SPI_HID_OUTPUT_BODY_LEN);
+	ret = spi_hid_device_descriptor_request(shid);
 	if (ret) {
 		dev_err(dev, "failed to send device descriptor request\n");
-		schedule_work(&shid->error_work);
+		spi_hid_schedule_recovery(shid, SPI_HID_RECOVERY_HARD_RESET);
 		return;
 	}
 }
 
-static int spi_hid_input_report_handler(struct spi_hid *shid,
-		struct spi_hid_input_buf *buf)
+/* Called with clk_lock held */
+static void spi_hid_clk_update_speed(struct spi_hid *shid)
 {
-	struct device *dev = &shid->spi->dev;
-	struct spi_hid_input_report r;
-	int ret;
+	u32 speed_hz = shid->clk_rate_hz[shid->clk_state];
 
-	dev_err(dev, "Input Report Handler\n");
+	if (shid->lowlat_active && shid->lowlat_speed_hz)
+		speed_hz = shid->lowlat_speed_hz;
 
-	trace_spi_hid_input_report_handler(shid);
+	WRITE_ONCE(shid->xfer_speed_hz, speed_hz);
+}
 
-	if (!shid->ready) {
-		dev_err(dev, "discarding input report, not ready!\n");
-		return 0;
-	}
+/* Called with clk_lock held */
+static void spi_hid_clk_set_state(struct spi_hid *shid, u8 state)
+{
+	ktime_t now = ktime_get();
 
-	if (shid->refresh_in_progress) {
-		dev_err(dev, "discarding input report, refresh in progress!\n");
-		return 0;
-	}
+	shid->clk_residency_ns[shid->clk_state] +=
+			ktime_to_ns(ktime_sub(now, shid->clk_since));
+	shid->clk_since = now;
 
-	if (!shid->hid) {
-		dev_err(dev, "discarding input report, no HID device!\n");
-		return 0;
+	if (shid->clk_state != state) {
+		shid->clk_state = state;
+		shid->clk_switches++;
 	}
 
-	spi_hid_input_report_prepare(buf, &r);
+	spi_hid_clk_update_speed(shid);
+}
 
-	/* MSHW0231 Multi-Collection Filtering: Windows-compatible Collection 06 targeting */
-	if (spi_hid_is_mshw0231(shid) && shid->windows_multi_collection_mode) {
-		/* Windows creates separate devices for each collection (COL01-COL07)
-		 * We target Collection 06 specifically: "Surface Touch Screen Device"
-		 * Collection ID may be embedded in report content or header
-		 */
-		if (r.content_length > 0 && shid->target_collection == MSHW0231_COLLECTION_TOUCHSCREEN) {
-			u8 collection_id = r.content[0] >> 4; /* Upper nibble collection hint */
-			dev_dbg(dev, "MSHW0231 Collection 06 device: report collection_id=0x%02x, content_id=0x%02x, length=%d\n",
-				collection_id, r.content_id, r.content_length);
-			
-			/* Accept reports that match our target collection OR are unspecified */
-			if (collection_id != MSHW0231_COLLECTION_TOUCHSCREEN && collection_id != 0x00) {
-				dev_dbg(dev, "MSHW0231: Filtering out non-Collection-06 report (collection=0x%02x)\n", collection_id);
-				return 0;
-			}
-			if (collection_id == MSHW0231_COLLECTION_TOUCHSCREEN) {
-				dev_dbg(dev, "MSHW0231: Processing Collection 06 touchscreen report\n");
-			}
-		}
-	}
+static void spi_hid_clk_update(struct spi_hid *shid)
+{
+	unsigned long flags;
 
-	if (shid->perf_mode &&
-			(r.content_id == SPI_HID_RIGHT_SCREEN_TOUCH_HEAT_MAP_REPORT_ID ||
-			r.content_id == SPI_HID_LEFT_SCREEN_TOUCH_HEAT_MAP_REPORT_ID)) {
-		r.content[1] = shid->touch_signature_index >> 8;
-		r.content[0] = shid->touch_signature_index++;
-	}
+	spin_lock_irqsave(&shid->clk_lock, flags);
+	spi_hid_clk_update_speed(shid);
+	spin_unlock_irqrestore(&shid->clk_lock, flags);
+}
 
-	ret = hid_input_report(shid->hid, HID_INPUT_REPORT,
-			r.content - 1,
-			r.content_length + 1, 1);
+static void spi_hid_clk_idle_work(struct work_struct *work)
+{
+	struct spi_hid *shid = container_of(to_delayed_work(work),
+			struct spi_hid, clk_idle_work);
+	unsigned long flags;
+
+	spin_lock_irqsave(&shid->clk_lock, flags);
+	shid->clk_burst = 0;
+	spi_hid_clk_set_state(shid, SPI_HID_CLK_IDLE);
+	spin_unlock_irqrestore(&shid->clk_lock, flags);
+}
+
+/*
+* Called from the input path for every input report. clk_up_reports reports
+* in a row, each within clk_idle_ms of the last, switch transfers to the
+* active rate. clk_idle_ms without a report switch back to the idle rate.
+* Scaling is off while the active rate is 0.
+*/
+static void spi_hid_clk_activity(struct spi_hid *shid)
+{
+	unsigned long flags;
+
+	if (!shid->clk_rate_hz[SPI_HID_CLK_ACTIVE])
+		return;
+
+	spin_lock_irqsave(&shid->clk_lock, flags);
+	if (shid->clk_state == SPI_HID_CLK_IDLE &&
+			++shid->clk_burst >= shid->clk_up_reports)
+		spi_hid_clk_set_state(shid, SPI_HID_CLK_ACTIVE);
+	spin_unlock_irqrestore(&shid->clk_lock, flags);
+
+	mod_delayed_work(shid->wq, &shid->clk_idle_work,
+			msecs_to_jiffies(shid->clk_idle_ms));
+}
+
+static int spi_hid_clk_cal_xfer(struct spi_hid *shid, u32 speed_hz,
+		void *buf, u16 length)
+{
+	struct spi_transfer xfers[2] = {
+		{
+			.tx_buf = shid->clk_cal_approval,
+			.len = SPI_HID_READ_APPROVAL_LEN,
+			.speed_hz = speed_hz,
+		}, {
+			.rx_buf = buf,
+			.len = length,
+			.speed_hz = speed_hz,
+		},
+	};
+	struct spi_message message;
+
+	memset(buf, 0, length);
+	spi_message_init_with_transfers(&message, xfers, 2);
+
+	return spi_sync(shid->spi, &message);
+}
+
+/*
+* Reads one whole descriptor response frame, header and body, so that the
+* device is never left waiting for the body of a frame.
+*/
+static int spi_hid_clk_cal_read(struct spi_hid *shid, u32 speed_hz)
+{
+	struct spi_hid_input_buf *buf = &shid->clk_cal_buf;
+	struct spi_hid_input_header header;
+	struct spi_hid_input_body body;
+	int ret;
+
+	ret = spi_hid_device_descriptor_request(shid);
+	if (ret)
+		return ret;
+	msleep(SPI_HID_CLK_CAL_SETTLE_MS);
+
+	ret = spi_hid_clk_cal_xfer(shid, speed_hz, buf->header,
+			sizeof(buf->header));
+	if (ret)
+		return ret;
+
+	spi_hid_populate_input_header(buf->header, &header);
+
+	if (header.sync_const != SPI_HID_INPUT_HEADER_SYNC_BYTE ||
+		header.version != SPI_HID_INPUT_HEADER_VERSION ||
+		header.report_length < sizeof(buf->body) ||
+		header.report_length > sizeof(buf->body) + sizeof(buf->content))
+		return -EPROTO;
+
+	ret = spi_hid_clk_cal_xfer(shid, speed_hz, buf->body,
+			header.report_length);
+	if (ret)
+		return ret;
+
+	spi_hid_populate_input_body(buf->body, &body);
+
+	if (body.content_length > header.report_length)
+		return -EPROTO;
+
+	return 0;
+}
+
+/*
+* Sweeps the controller rates from the slowest up, with clk_cal_reads
+* descriptor response reads each, and stops at the first error so that at
+* most one frame is left half read; the input path resyncs on it once the
+* IRQ is back. The IRQ stays off so the responses are read here rather than
+* by the input path. The fastest rate that passed, with every slower rate
+* passing too, less SPI_HID_CLK_CAL_MARGIN_STEPS, becomes the active clock
+* scaling rate.
+*/
+static void spi_hid_clk_cal_work(struct work_struct *work)
+{
+	struct spi_hid *shid =
+		container_of(work, struct spi_hid, clk_cal_work);
+	struct device *dev = &shid->spi->dev;
+	unsigned long flags;
+	int best = -1;
+	int ret, i, n;
+
+	ret = pm_runtime_resume_and_get(dev);
+	if (ret)
+		goto out;
+
+	mutex_lock(&shid->power_lock);
+
+	if (!shid->ready || shid->power_state != SPI_HID_POWER_MODE_ACTIVE) {
+		ret = -EAGAIN;
+		goto unlock;
+	}
+
+	if (!shid->irq_enabled || shid->input_transfer_pending) {
+		ret = -EBUSY;
+		goto unlock;
+	}
+
+	disable_irq(shid->irq);
+	shid->irq_enabled = false;
+
+	spi_hid_read_approval(shid->desc.input_register,
+			shid->clk_cal_approval);
+
+	memset(shid->clk_cal_errors, 0, sizeof(shid->clk_cal_errors));
+	shid->clk_cal_tested = 0;
+
+	for (i = SPI_HID_CLK_CAL_STEPS - 1; i >= 0; i--) {
+		shid->clk_cal_tested++;
+		for (n = 0; n < shid->clk_cal_reads; n++) {
+			if (spi_hid_clk_cal_read(shid, spi_hid_clk_cal_hz[i])) {
+				shid->clk_cal_errors[i]++;
+				break;
+			}
+		}
+
+		if (shid->clk_cal_errors[i])
+			break;
+		best = i;
+	}
+
+	if (best < 0) {
+		ret = -EIO;
+		goto enable;
+	}
+
+	best = min(best + SPI_HID_CLK_CAL_MARGIN_STEPS,
+			SPI_HID_CLK_CAL_STEPS - 1);
+	shid->clk_cal_speed_hz = spi_hid_clk_cal_hz[best];
+
+	spin_lock_irqsave(&shid->clk_lock, flags);
+	shid->clk_rate_hz[SPI_HID_CLK_ACTIVE] = shid->clk_cal_speed_hz;
+	spi_hid_clk_set_state(shid, shid->clk_state);
+	spin_unlock_irqrestore(&shid->clk_lock, flags);
+
+	dev_info(dev, "SPI clock calibrated to %u Hz\n",
+			shid->clk_cal_speed_hz);
+
+enable:
+	enable_irq(shid->irq);
+	shid->irq_enabled = true;
+
+unlock:
+	mutex_unlock(&shid->power_lock);
+	pm_runtime_mark_last_busy(dev);
+	pm_runtime_put_autosuspend(dev);
+
+out:
+	if (ret)
+		dev_err(dev, "SPI clock calibration failed: %d\n", ret);
+	shid->clk_cal_status = ret;
+	shid->clk_cal_done = true;
+	sysfs_notify(&dev->kobj, NULL, "spi_hid_clk_calibrate");
+}
+
+/*
+* Called from the input path for every input report. Devices whose
+* descriptor reports no power support are never put to sleep, so the
+* governor does not arm for them at all.
+*/
+static void spi_hid_idle_activity(struct spi_hid *shid)
+{
+	if (shid->idle_sleep_ms && !shid->idle_sleeping &&
+		shid->desc.device_power_support != SPI_HID_POWER_SUPPORT_NONE)
+		mod_delayed_work(shid->wq, &shid->idle_work,
+				msecs_to_jiffies(shid->idle_sleep_ms));
+}
+
+/*
+* Low-latency mode. While input reports keep arriving, hold a CPU latency
+* QoS request so the CPU stays out of deep C-states, steer the IRQ to
+* lowlat_cpu and optionally clock transfers at lowlat_speed_hz. All of it
+* is dropped again after lowlat_idle_ms without input.
+*/
+static void spi_hid_lowlat_engage_work(struct work_struct *work)
+{
+	struct spi_hid *shid =
+		container_of(work, struct spi_hid, lowlat_engage_work);
+
+	mutex_lock(&shid->lowlat_lock);
+	if (!shid->lowlat_mode || shid->lowlat_active)
+		goto out;
+
+	cpu_latency_qos_add_request(&shid->lowlat_qos, 0);
+	if (shid->lowlat_cpu >= 0 && cpu_online(shid->lowlat_cpu)) {
+		/* Put back whatever affinity was set before, not all CPUs */
+		cpumask_copy(shid->lowlat_affinity,
+				irq_get_affinity_mask(shid->irq));
+		irq_set_affinity_and_hint(shid->irq,
+				cpumask_of(shid->lowlat_cpu));
+		shid->lowlat_steered = true;
+	}
+	shid->lowlat_active = true;
+	shid->lowlat_engaged_count++;
+	spi_hid_clk_update(shid);
+
+out:
+	mutex_unlock(&shid->lowlat_lock);
+}
+
+/* Called with lowlat_lock held */
+static void spi_hid_lowlat_release(struct spi_hid *shid)
+{
+	if (!shid->lowlat_active)
+		return;
+
+	shid->lowlat_active = false;
+	spi_hid_clk_update(shid);
+
+	if (shid->lowlat_steered) {
+		irq_update_affinity_hint(shid->irq, NULL);
+		irq_set_affinity(shid->irq, shid->lowlat_affinity);
+		shid->lowlat_steered = false;
+	}
+	cpu_latency_qos_remove_request(&shid->lowlat_qos);
+}
+
+static void spi_hid_lowlat_idle_work(struct work_struct *work)
+{
+	struct spi_hid *shid = container_of(to_delayed_work(work),
+			struct spi_hid, lowlat_idle_work);
+
+	mutex_lock(&shid->lowlat_lock);
+	spi_hid_lowlat_release(shid);
+	mutex_unlock(&shid->lowlat_lock);
+}
+
+static void spi_hid_lowlat_stop(struct spi_hid *shid)
+{
+	cancel_work_sync(&shid->lowlat_engage_work);
+	cancel_delayed_work_sync(&shid->lowlat_idle_work);
+
+	mutex_lock(&shid->lowlat_lock);
+	spi_hid_lowlat_release(shid);
+	mutex_unlock(&shid->lowlat_lock);
+}
+
+/* Called from the input path for every input report */
+static void spi_hid_lowlat_activity(struct spi_hid *shid)
+{
+	if (!shid->lowlat_mode)
+		return;
+
+	if (!shid->lowlat_active)
+		spi_hid_queue_work(shid, &shid->lowlat_engage_work);
+	mod_delayed_work(shid->wq, &shid->lowlat_idle_work,
+			msecs_to_jiffies(shid->lowlat_idle_ms));
+}
+
+static int spi_hid_input_report_handler(struct spi_hid *shid,
+		struct spi_hid_input_buf *buf)
+{
+	struct device *dev = &shid->spi->dev;
+	struct spi_hid_input_report r;
+	u64 now;
+	int ret;
+
+	dev_err(dev, "Input Report Handler\n");
+
+	trace_spi_hid_input_report_handler(shid);
+
+	if (!shid->ready) {
+		dev_err(dev, "discarding input report, not ready!\n");
+		spi_hid_stat_inc(shid, SPI_HID_STAT_DROPS);
+		return 0;
+	}
+
+	if (shid->refresh_in_progress) {
+		dev_err(dev, "discarding input report, refresh in progress!\n");
+		spi_hid_stat_inc(shid, SPI_HID_STAT_DROPS);
+		return 0;
+	}
+
+	if (!shid->hid) {
+		dev_err(dev, "discarding input report, no HID device!\n");
+		spi_hid_stat_inc(shid, SPI_HID_STAT_DROPS);
+		return 0;
+	}
+
+	spi_hid_input_report_prepare(buf, &r);
+
+	/* MSHW0231 Multi-Collection Filtering: Windows-compatible Collection 06 targeting */
+	if (spi_hid_is_mshw0231(shid) && shid->windows_multi_collection_mode) {
+		/* Windows creates separate devices for each collection (COL01-COL07)
+		 * We target Collection 06 specifically: "Surface Touch Screen Device"
+		 * Collection ID may be embedded in report content or header
+		 */
+		if (r.content_length > 0 && shid->target_collection == MSHW0231_COLLECTION_TOUCHSCREEN) {
+			u8 collection_id = r.content[0] >> 4; /* Upper nibble collection hint */
+			dev_dbg(dev, "MSHW0231 Collection 06 device: report collection_id=0x%02x, content_id=0x%02x, length=%d\n",
+				collection_id, r.content_id, r.content_length);
+			
+			/* Accept reports that match our target collection OR are unspecified */
+			if (collection_id != MSHW0231_COLLECTION_TOUCHSCREEN && collection_id != 0x00) {
+				dev_dbg(dev, "MSHW0231: Filtering out non-Collection-06 report (collection=0x%02x)\n", collection_id);
+				spi_hid_stat_inc(shid, SPI_HID_STAT_DROPS);
+				return 0;
+			}
+			if (collection_id == MSHW0231_COLLECTION_TOUCHSCREEN) {
+				dev_dbg(dev, "MSHW0231: Processing Collection 06 touchscreen report\n");
+			}
+		}
+	}
+
+	if (shid->perf_mode &&
+			(r.content_id == SPI_HID_RIGHT_SCREEN_TOUCH_HEAT_MAP_REPORT_ID ||
+			r.content_id == SPI_HID_LEFT_SCREEN_TOUCH_HEAT_MAP_REPORT_ID)) {
+		r.content[1] = shid->touch_signature_index >> 8;
+		r.content[0] = shid->touch_signature_index++;
+	}
+
+	ret = hid_input_report(shid->hid, HID_INPUT_REPORT,
+			r.content - 1,
+			r.content_length + 1, 1);
+
+	now = ktime_get_ns();
+	spi_hid_lat_record(shid, SPI_HID_LAT_DELIVERY, shid->lat_body_ns, now);
+	spi_hid_lat_record(shid, SPI_HID_LAT_TOTAL,
+			shid->interrupt_time_stamps[0], now);
+	/* Reports too short to carry a signature are logged with 0 */
+	spi_hid_lat_log_add(shid, r.content_id,
+			r.content_length < 2 ? 0 :
+			(r.content[1] << 8) | r.content[0],
+			shid->interrupt_time_stamps[0], now);
+	trace_spi_hid_input_delivered(shid, r.content_id, r.content_length,
+			shid->interrupt_time_stamps[0], now, ret);
+	if (shid->interrupt_time_stamps[0])
+		spi_hid_wd_latency(shid, now - shid->interrupt_time_stamps[0]);
+
+	spi_hid_timeline_mark(shid, SPI_HID_TL_FIRST_INPUT);
+	spi_hid_lowlat_activity(shid);
+	spi_hid_clk_activity(shid);
+	spi_hid_idle_activity(shid);
 
 	if (shid->perf_mode &&
 			(r.content_id == SPI_HID_HEARTBEAT_REPORT_ID ||
@@ -576,6 +1998,7 @@ static int spi_hid_input_report_handler(struct spi_hid *shid,
 
 	if (ret == -ENODEV || ret == -EBUSY) {
 		dev_err(dev, "ignoring report --> %d\n", ret);
+		spi_hid_stat_inc(shid, SPI_HID_STAT_DROPS);
 		return 0;
 	}
 
@@ -588,11 +2011,13 @@ static int spi_hid_response_handler(struct spi_hid *shid,
 	trace_spi_hid_response_handler(shid);
 	dev_err(&shid->spi->dev, "Response Handler\n");
 
+	spi_hid_windows_stage_event(shid, MSHW0231_STAGE_EVENT_RESPONSE);
+
 	/* completion_done returns 0 if there are waiters, otherwise 1 */
-	if (completion_done(&shid->output_done))
+	if (completion_done(&shid->response_done))
 		dev_err(&shid->spi->dev, "Unexpected response report\n");
 	else
-		complete(&shid->output_done);
+		complete(&shid->response_done);
 
 	return 0;
 }
@@ -605,14 +2030,13 @@ static int spi_hid_send_output_report(struct spi_hid *shid, u32 output_register,
 
 	u16 padded_length;
 	u16 body_length;
-	u8 padding;
+	u16 content_bytes;
 	u16 max_length;
 
 	int ret;
 
 	body_length = sizeof(buf->body) + report->content_length;
 	padded_length = round_up(body_length, 4);
-	padding = padded_length - body_length;
 	max_length = round_up(shid->desc.max_output_length + 3
 						+ sizeof(buf->body), 4);
 
@@ -631,10 +2055,14 @@ static int spi_hid_send_output_report(struct spi_hid *shid, u32 output_register,
 	spi_hid_output_header(buf->header, output_register, padded_length);
 	spi_hid_output_body(buf->body, report);
 
-	if (report->content_length > 3)
-		memcpy(&buf->content, report->content, report->content_length);
+	/* content_length counts the length and ID fields as well */
+	content_bytes = report->content_length > 3 ?
+			report->content_length - 3 : 0;
+	if (content_bytes)
+		memcpy(&buf->content, report->content, content_bytes);
 
-	memset(&buf->content[report->content_length], 0, padding);
+	memset(&buf->content[content_bytes], 0,
+			padded_length - sizeof(buf->body) - content_bytes);
 
 	ret = spi_hid_output(shid, buf, sizeof(buf->header) +
 			padded_length);
@@ -649,83 +2077,238 @@ out:
 	return ret;
 }
 
-/*
-* This function shouldn't be called from the interrupt thread context since it
-* waits for completion that gets completed in one of the future runs of the
-* interrupt thread.
-*/
-static int spi_hid_sync_request(struct spi_hid *shid, u16 output_register,
-		struct spi_hid_output_report *report)
+static void spi_hid_request_done(struct spi_hid_request *req, int status)
 {
-	struct device *dev = &shid->spi->dev;
-	int ret = 0;
+	if (req->async) {
+		kfree(req);
+		return;
+	}
 
+	req->status = status;
+	complete(&req->done);
+}
 
-	ret = spi_hid_send_output_report(shid, output_register,
-			report);
-	if (ret) {
-		dev_err(dev, "failed to transfer output report\n");
-		return ret;
-	}
+static struct spi_hid_request *spi_hid_request_dequeue(struct spi_hid *shid)
+{
+	struct spi_hid_request *req;
+	unsigned long flags;
 
-	mutex_unlock(&shid->lock);
-	ret = wait_for_completion_interruptible_timeout(&shid->output_done,
-			msecs_to_jiffies(1000));
-	mutex_lock(&shid->lock);
-	if (ret == 0) {
-		dev_err(dev, "response timed out\n");
-		schedule_work(&shid->error_work);
-		return -ETIMEDOUT;
-	}
+	spin_lock_irqsave(&shid->request_lock, flags);
+	req = list_first_entry_or_null(&shid->request_queue,
+			struct spi_hid_request, list);
+	if (req)
+		list_del_init(&req->list);
+	spin_unlock_irqrestore(&shid->request_lock, flags);
 
-	return 0;
+	return req;
 }
 
-/*
-* This function returns the length of the report descriptor, or a negative
-* error code if something went wrong.
-*/
-static int spi_hid_report_descriptor_request(struct spi_hid *shid)
+static void spi_hid_request_process(struct spi_hid *shid,
+		struct spi_hid_request *req)
 {
-	int ret;
 	struct device *dev = &shid->spi->dev;
-	struct spi_hid_output_report report = {
-		.content_type = SPI_HID_CONTENT_TYPE_COMMAND,
-		.content_length = 3,
-		.content_id = 0,
-		.content = NULL,
-	};
-
+	int length;
+	int ret;
 
-	ret =  spi_hid_sync_request(shid,
-			shid->desc.report_descriptor_register, &report);
+	mutex_lock(&shid->lock);
+	reinit_completion(&shid->response_done);
+	ret = spi_hid_send_output_report(shid, req->output_register,
+			&req->report);
+	mutex_unlock(&shid->lock);
 	if (ret) {
-		dev_err(dev, "Expected report descriptor not received!\n");
+		dev_err(dev, "failed to transfer output report\n");
 		goto out;
 	}
 
-	ret = (shid->response.body[0] | (shid->response.body[1] << 8)) - 3;
-	if (ret != shid->desc.report_descriptor_length) {
-		dev_err(dev, "Received report descriptor length doesn't match device descriptor field, using min of the two\n");
-		ret = min_t(unsigned int, ret,
-			shid->desc.report_descriptor_length);
+	if (!req->response)
+		goto out;
+
+	if (!wait_for_completion_timeout(&shid->response_done,
+			msecs_to_jiffies(SPI_HID_RESPONSE_TIMEOUT_MS))) {
+		dev_err(dev, "response timed out\n");
+		spi_hid_schedule_recovery(shid,
+				SPI_HID_RECOVERY_PROTOCOL_RESET);
+		ret = -ETIMEDOUT;
+		goto out;
+	}
+
+	/*
+	 * The response slot is only rewritten by the next response, which
+	 * cannot arrive before we send the next request, so copying it out
+	 * here is race free.
+	 */
+	length = (shid->response.body[0] | (shid->response.body[1] << 8)) - 3;
+	if (length < 0) {
+		dev_err(dev, "Response length %d underflow\n", length);
+		ret = -EPROTO;
+		goto out;
 	}
+
+	ret = min_t(int, length, req->response_size);
+	memcpy(req->response, shid->response.content, ret);
+
 out:
-	return ret;
+	if (req->delay_ms)
+		msleep(req->delay_ms);
+
+	spi_hid_request_done(req, ret);
 }
 
-static int spi_hid_process_input_report(struct spi_hid *shid,
-		struct spi_hid_input_buf *buf)
+/*
+* Services the request queue in FIFO order. Only one request is in flight at
+* a time since the protocol does not tag responses to requests.
+*/
+static void spi_hid_request_work(struct work_struct *work)
 {
-	struct spi_hid_input_header header;
-	struct spi_hid_input_body body;
-	struct device *dev = &shid->spi->dev;
-	struct spi_hid_device_desc_raw *raw;
-	int ret;
+	struct spi_hid *shid =
+		container_of(work, struct spi_hid, request_work);
+	struct spi_hid_request *req;
 
-	trace_spi_hid_process_input_report(shid);
+	while ((req = spi_hid_request_dequeue(shid)))
+		spi_hid_request_process(shid, req);
+}
 
-	spi_hid_populate_input_header(buf->header, &header);
+static void spi_hid_request_queue_stop(struct spi_hid *shid)
+{
+	struct spi_hid_request *req;
+	unsigned long flags;
+
+	spin_lock_irqsave(&shid->request_lock, flags);
+	shid->request_queue_dead = true;
+	spin_unlock_irqrestore(&shid->request_lock, flags);
+
+	cancel_work_sync(&shid->request_work);
+
+	while ((req = spi_hid_request_dequeue(shid)))
+		spi_hid_request_done(req, -ESHUTDOWN);
+}
+
+/*
+* Queues a request without waiting for it, for callers that can't sleep
+* such as the input path. @delay_ms of quiet time follow the output before
+* the next request is sent. Returns 0 once queued, or a negative error
+* code.
+*/
+static int spi_hid_async_request(struct spi_hid *shid, u16 output_register,
+		struct spi_hid_output_report *report, u32 delay_ms)
+{
+	u16 content_bytes = report->content_length > 3 ?
+			report->content_length - 3 : 0;
+	struct spi_hid_request *req;
+	unsigned long flags;
+
+	req = kzalloc(struct_size(req, content, content_bytes), GFP_ATOMIC);
+	if (!req)
+		return -ENOMEM;
+
+	req->output_register = output_register;
+	req->report = *report;
+	req->report.content = req->content;
+	if (content_bytes)
+		memcpy(req->content, report->content, content_bytes);
+	req->async = true;
+	req->delay_ms = delay_ms;
+
+	spin_lock_irqsave(&shid->request_lock, flags);
+	if (shid->request_queue_dead) {
+		spin_unlock_irqrestore(&shid->request_lock, flags);
+		kfree(req);
+		return -ESHUTDOWN;
+	}
+	list_add_tail(&req->list, &shid->request_queue);
+	spin_unlock_irqrestore(&shid->request_lock, flags);
+
+	spi_hid_queue_work(shid, &shid->request_work);
+
+	return 0;
+}
+
+/*
+* Queues a request and waits for the worker to service it. Callers must not
+* hold shid->lock, and this function shouldn't be called from the interrupt
+* thread context since the response is delivered by a future run of the
+* interrupt thread. Returns the response length if @response is set,
+* otherwise 0, or a negative error code.
+*/
+static int spi_hid_sync_request(struct spi_hid *shid, u16 output_register,
+		struct spi_hid_output_report *report, u8 *response,
+		u16 response_size)
+{
+	struct spi_hid_request req = {
+		.output_register = output_register,
+		.report = *report,
+		.response = response,
+		.response_size = response_size,
+	};
+	unsigned long flags;
+
+	init_completion(&req.done);
+
+	spin_lock_irqsave(&shid->request_lock, flags);
+	if (shid->request_queue_dead) {
+		spin_unlock_irqrestore(&shid->request_lock, flags);
+		return -ESHUTDOWN;
+	}
+	list_add_tail(&req.list, &shid->request_queue);
+	spin_unlock_irqrestore(&shid->request_lock, flags);
+
+	spi_hid_queue_work(shid, &shid->request_work);
+
+	/*
+	 * The worker always completes the request, at the latest after the
+	 * response timeout, and it references our stack frame until then.
+	 */
+	wait_for_completion(&req.done);
+
+	return req.status;
+}
+
+/*
+* This function returns the length of the report descriptor, or a negative
+* error code if something went wrong.
+*/
+static int spi_hid_report_descriptor_request(struct spi_hid *shid,
+		u8 *buf, u16 len)
+{
+	int ret;
+	struct device *dev = &shid->spi->dev;
+	struct spi_hid_output_report report = {
+		.content_type = SPI_HID_CONTENT_TYPE_COMMAND,
+		.content_length = 3,
+		.content_id = 0,
+		.content = NULL,
+	};
+
+
+	ret =  spi_hid_sync_request(shid,
+			shid->desc.report_descriptor_register, &report,
+			buf, len);
+	if (ret < 0) {
+		dev_err(dev, "Expected report descriptor not received!\n");
+		goto out;
+	}
+
+	if (ret != shid->desc.report_descriptor_length) {
+		dev_err(dev, "Received report descriptor length doesn't match device descriptor field, using min of the two\n");
+		ret = min_t(unsigned int, ret,
+			shid->desc.report_descriptor_length);
+	}
+out:
+	return ret;
+}
+
+static int spi_hid_process_input_report(struct spi_hid *shid,
+		struct spi_hid_input_buf *buf)
+{
+	struct spi_hid_input_header header;
+	struct spi_hid_input_body body;
+	struct device *dev = &shid->spi->dev;
+	struct spi_hid_device_desc_raw *raw;
+	int ret;
+
+	trace_spi_hid_process_input_report(shid);
+
+	spi_hid_populate_input_header(buf->header, &header);
 	spi_hid_populate_input_body(buf->body, &body);
 
 	if (body.content_length > header.report_length) {
@@ -735,6 +2318,8 @@ static int spi_hid_process_input_report(struct spi_hid *shid,
 			init_responses++;
 			
 			dev_info(dev, "MSHW0231: Device initialization handshake received (0xFFFD) - response #%d\n", init_responses);
+			spi_hid_windows_stage_event(shid,
+					MSHW0231_STAGE_EVENT_RESPONSE);
 			
 			/* MSHW0231: BASELINE ACTIVITY CAPTURE - Log patterns without generating touch events */
 			if (shid->hid) {
@@ -987,7 +2572,7 @@ static int spi_hid_process_input_report(struct spi_hid *shid,
 				/* Create HID device now that touchscreen is ready */
 				if (!shid->hid) {
 					dev_info(dev, "MSHW0231: Creating HID device for operational touchscreen\n");
-					schedule_work(&shid->create_device_work);
+					spi_hid_queue_work(shid, &shid->create_device_work);
 				}
 				
 				/* BREAKTHROUGH ATTEMPT: Activate Collection 06 touch reporting mode */
@@ -1099,17 +2684,23 @@ static int spi_hid_process_input_report(struct spi_hid *shid,
 						body.content_length, header.report_length, body_bypass_attempts + 1);
 				}
 				body_bypass_attempts++;
+				spi_hid_stat_inc(shid, SPI_HID_STAT_DROPS);
 				return 0;
 			}
 		}
 		dev_err(dev, "Bad body length %d > %d\n", body.content_length,
 							header.report_length);
+		spi_hid_stat_inc(shid, SPI_HID_STAT_DROPS);
 		return -EINVAL;
 	}
 
+	/* Only frames that passed validation count as reports */
+	spi_hid_stats_report(shid, &header, body.content_id);
+
 	if (body.content_id == SPI_HID_HEARTBEAT_REPORT_ID) {
 		dev_warn(dev, "Heartbeat ID 0x%x from device %u\n",
 			buf->content[1], buf->content[0]);
+		spi_hid_wd_heartbeat(shid);
 	}
 
 	switch (header.report_type) {
@@ -1117,19 +2708,31 @@ static int spi_hid_process_input_report(struct spi_hid *shid,
 		ret = spi_hid_input_report_handler(shid, buf);
 		break;
 	case SPI_HID_REPORT_TYPE_RESET_RESP:
-		schedule_work(&shid->reset_work);
+		shid->reset_response_time = ktime_get();
+		spi_hid_timeline_mark(shid, SPI_HID_TL_RESET_RESPONSE);
+		complete(&shid->reset_response);
+		spi_hid_windows_stage_event(shid,
+				MSHW0231_STAGE_EVENT_RESET_RESP);
+		spi_hid_queue_work(shid, &shid->reset_work);
 		ret = 0;
 		break;
 	case SPI_HID_REPORT_TYPE_DEVICE_DESC:
 		dev_err(dev, "Received device descriptor\n");
-		/* Reset attempts at every device descriptor fetch */
-		shid->attempts = 0;
+		shid->reset_desc_time = ktime_get();
+		spi_hid_timeline_mark(shid, SPI_HID_TL_DEVICE_DESC);
 		raw = (struct spi_hid_device_desc_raw *) buf->content;
 		spi_hid_parse_dev_desc(raw, &shid->desc);
+		/*
+		* The MSHW0231 descriptor flags are not known to follow this
+		* layout, so keep powering it off rather than sleeping it
+		*/
+		if (spi_hid_is_mshw0231(shid))
+			shid->desc.device_power_support =
+				SPI_HID_POWER_SUPPORT_NONE;
 		if (!shid->hid) {
-			schedule_work(&shid->create_device_work);
+			spi_hid_queue_work(shid, &shid->create_device_work);
 		} else {
-			schedule_work(&shid->refresh_device_work);
+			spi_hid_queue_work(shid, &shid->refresh_device_work);
 		}
 		ret = 0;
 		break;
@@ -1362,16 +2965,86 @@ static int spi_hid_create_mshw0231_multi_collections(struct spi_hid *shid)
 	return ret;
 }
 
+static bool spi_hid_desc_cache_match(struct spi_hid *shid)
+{
+	struct spi_hid_desc_cache *cache = &shid->desc_cache;
+
+	return cache->valid &&
+		cache->desc.vendor_id == shid->desc.vendor_id &&
+		cache->desc.product_id == shid->desc.product_id &&
+		cache->desc.version_id == shid->desc.version_id &&
+		cache->desc.report_descriptor_length ==
+			shid->desc.report_descriptor_length;
+}
+
+/*
+* Copies the cached report descriptor into @buf if the cache matches the
+* current device descriptor. Returns the descriptor length or -ENOENT.
+*/
+static int spi_hid_desc_cache_lookup(struct spi_hid *shid, u8 *buf, u16 len)
+{
+	struct spi_hid_desc_cache *cache = &shid->desc_cache;
+	int ret = -ENOENT;
+
+	mutex_lock(&cache->lock);
+	if (spi_hid_desc_cache_match(shid) && cache->report_desc_len <= len) {
+		memcpy(buf, cache->report_desc, cache->report_desc_len);
+		ret = cache->report_desc_len;
+		cache->hits++;
+	} else {
+		cache->misses++;
+	}
+	mutex_unlock(&cache->lock);
+
+	return ret;
+}
+
+static void spi_hid_desc_cache_store(struct spi_hid *shid, const u8 *buf,
+		u16 len)
+{
+	struct spi_hid_desc_cache *cache = &shid->desc_cache;
+	u8 *copy;
+
+	copy = kmemdup(buf, len, GFP_KERNEL);
+
+	mutex_lock(&cache->lock);
+	kfree(cache->report_desc);
+	cache->report_desc = copy;
+	cache->valid = copy != NULL;
+	if (copy) {
+		cache->desc = shid->desc;
+		cache->report_desc_len = len;
+		cache->crc32 = crc32_le(0, copy, len);
+	}
+	mutex_unlock(&cache->lock);
+}
+
+/*
+* Accounts for a device descriptor from the works it queues. The reset
+* timing and attempt budget belong to the error handler, which runs under
+* power_lock.
+*/
+static void spi_hid_reset_desc_received(struct spi_hid *shid)
+{
+	mutex_lock(&shid->power_lock);
+	spi_hid_reset_mark_at(shid, SPI_HID_RESET_PHASE_DESCRIPTOR,
+			shid->reset_desc_time);
+	/* Reset attempts at every device descriptor fetch */
+	shid->attempts = 0;
+	mutex_unlock(&shid->power_lock);
+}
+
 static void spi_hid_create_device_work(struct work_struct *work)
 {
 	struct spi_hid *shid =
 		container_of(work, struct spi_hid, create_device_work);
 	struct device *dev = &shid->spi->dev;
-	u8 prev_state = shid->power_state;
 	int ret;
 
 	trace_spi_hid_create_device_work(shid);
+	spi_hid_timeline_mark(shid, SPI_HID_TL_CREATE_DEVICE);
 	dev_err(dev, "Create device work\n");
+	spi_hid_reset_desc_received(shid);
 
 	if (shid->desc.hid_version != SPI_HID_SUPPORTED_VERSION) {
 		/* MSHW0231: Use default descriptor for Surface touchscreen */
@@ -1390,7 +3063,8 @@ static void spi_hid_create_device_work(struct work_struct *work)
 		} else {
 			dev_err(dev, "Unsupported device descriptor version %4x\n",
 				shid->desc.hid_version);
-			schedule_work(&shid->error_work);
+			spi_hid_schedule_recovery(shid,
+					SPI_HID_RECOVERY_HARD_RESET);
 			return;
 		}
 	}
@@ -1400,6 +3074,14 @@ static void spi_hid_create_device_work(struct work_struct *work)
 		dev_err(dev, "Failed to create hid device\n");
 		return;
 	}
+	mutex_lock(&shid->power_lock);
+	spi_hid_reset_mark(shid, SPI_HID_RESET_PHASE_READY);
+	shid->attempts = 0;
+	mutex_unlock(&shid->power_lock);
+	spi_hid_timeline_mark(shid, SPI_HID_TL_HID_CREATED);
+
+	if (calibrate_clock && !shid->clk_cal_done)
+		spi_hid_queue_work(shid, &shid->clk_cal_work);
 
 	/* MSHW0231: Create Windows-style multi-collection devices */
 	if (spi_hid_is_mshw0231(shid)) {
@@ -1410,69 +3092,92 @@ static void spi_hid_create_device_work(struct work_struct *work)
 		}
 	}
 
-	shid->attempts = 0;
-	if (shid->irq_enabled) {
-		disable_irq(shid->irq);
-		shid->irq_enabled = false;
-	} else {
-		dev_err(dev, "%s called with interrupt already disabled\n",
-								__func__);
-		shid->logic_error_count++;
-		shid->logic_last_error = -ENOEXEC;
-	}
-	ret = spi_hid_power_down(shid);
-	if (ret) {
-		dev_err(dev, "%s: could not power down\n", __func__);
+	if (!shid->pm_bringup_ref)
+		return;
+
+	/*
+	* Userspace usually opens the new device within moments. Keep it up
+	* for the grace window so that open does not have to wait for a full
+	* power cycle, and leave powering down to runtime PM after that.
+	*/
+	if (shid->open_grace_ms) {
+		queue_delayed_work(shid->wq, &shid->grace_work,
+				msecs_to_jiffies(shid->open_grace_ms));
 		return;
 	}
 
-	shid->power_state = SPI_HID_POWER_MODE_OFF;
-	dev_err(dev, "%s: %s -> %s\n", __func__,
-			spi_hid_power_mode_string(prev_state),
-			spi_hid_power_mode_string(shid->power_state));
+	shid->pm_bringup_ref = false;
+	pm_runtime_mark_last_busy(dev);
+	pm_runtime_put_autosuspend(dev);
 }
 
-static void spi_hid_refresh_device_work(struct work_struct *work)
+/*
+* Refetches the report descriptor and recreates the HID device if it has
+* changed. With @use_cache, a matching cache entry makes the device ready
+* right away and the refetch is deferred to desc_validate_work.
+*/
+static void spi_hid_refresh_device(struct spi_hid *shid, bool use_cache)
 {
-	struct spi_hid *shid =
-		container_of(work, struct spi_hid, refresh_device_work);
 	struct device *dev = &shid->spi->dev;
 	struct hid_device *hid;
+	u8 *descriptor;
 	int ret;
 	u32 new_crc32;
 
-	trace_spi_hid_refresh_device_work(shid);
-	dev_err(dev, "Refresh device work\n");
-
 	if (shid->desc.hid_version != SPI_HID_SUPPORTED_VERSION) {
 		dev_err(dev, "Unsupported device descriptor version %4x\n",
 			shid->desc.hid_version);
-		schedule_work(&shid->error_work);
+		spi_hid_schedule_recovery(shid, SPI_HID_RECOVERY_HARD_RESET);
 		return;
 	}
 
+	descriptor = kzalloc(SPI_HID_MAX_REPORT_DESC_LEN, GFP_KERNEL);
+	if (!descriptor)
+		return;
+
 	mutex_lock(&shid->power_lock);
 
 	if (shid->power_state == SPI_HID_POWER_MODE_OFF)
 		goto out;
 
-	mutex_lock(&shid->lock);
-	ret = spi_hid_report_descriptor_request(shid);
-	mutex_unlock(&shid->lock);
+	if (use_cache) {
+		ret = spi_hid_desc_cache_lookup(shid, descriptor,
+				SPI_HID_MAX_REPORT_DESC_LEN);
+		if (ret >= 0) {
+			dev_err(dev, "Refresh device work - descriptor cache hit\n");
+			shid->ready = true;
+			spi_hid_reset_mark(shid, SPI_HID_RESET_PHASE_READY);
+			sysfs_notify(&dev->kobj, NULL, "ready");
+			spi_hid_queue_work(shid, &shid->desc_validate_work);
+			goto out;
+		}
+	} else if (!shid->ready) {
+		/* A reset is in flight and will refresh the device itself */
+		goto out;
+	}
+
+	ret = spi_hid_report_descriptor_request(shid, descriptor,
+			SPI_HID_MAX_REPORT_DESC_LEN);
 	if (ret < 0) {
 		dev_err(dev, "Refresh: failed report descriptor request, error %d", ret);
 		goto out;
 	}
 
-	new_crc32 = crc32_le(0, (unsigned char const *) shid->response.content, (size_t)ret);
+	spi_hid_desc_cache_store(shid, descriptor, ret);
+
+	new_crc32 = crc32_le(0, (unsigned char const *) descriptor, (size_t)ret);
 	if (new_crc32 == shid->report_descriptor_crc32)
 	{
 		dev_err(dev, "Refresh device work - returning\n");
 		shid->ready = true;
+		spi_hid_reset_mark(shid, SPI_HID_RESET_PHASE_READY);
 		sysfs_notify(&dev->kobj, NULL, "ready");
 		goto out;
 	}
 
+	if (!use_cache)
+		shid->desc_cache.stale++;
+
 	dev_err(dev, "Re-creating the HID device\n");
 
 	shid->report_descriptor_crc32 = new_crc32;
@@ -1491,14 +3196,59 @@ static void spi_hid_refresh_device_work(struct work_struct *work)
 
 	shid->refresh_in_progress = false;
 	shid->ready = true;
+	spi_hid_reset_mark(shid, SPI_HID_RESET_PHASE_READY);
 	sysfs_notify(&dev->kobj, NULL, "ready");
 
 out:
 	mutex_unlock(&shid->power_lock);
+	kfree(descriptor);
+}
+
+static void spi_hid_refresh_device_work(struct work_struct *work)
+{
+	struct spi_hid *shid =
+		container_of(work, struct spi_hid, refresh_device_work);
+	struct device *dev = &shid->spi->dev;
+
+	trace_spi_hid_refresh_device_work(shid);
+	dev_err(dev, "Refresh device work\n");
+	spi_hid_reset_desc_received(shid);
+
+	spi_hid_refresh_device(shid, true);
+}
+
+static void spi_hid_desc_validate_work(struct work_struct *work)
+{
+	struct spi_hid *shid =
+		container_of(work, struct spi_hid, desc_validate_work);
+
+	spi_hid_refresh_device(shid, false);
 }
 
 static void spi_hid_input_header_complete(void *_shid);
 
+/*
+* Called from the input path with input_lock held after a failed header or
+* body. A single bad frame is handled by dropping it and re-reading the
+* header; anything worse is left to the recovery ladder. Returns 0 if the
+* header is being re-read, otherwise an error and the caller must drop the
+* pending transfers.
+*/
+static int spi_hid_input_recover(struct spi_hid *shid, int err)
+{
+	u8 step;
+
+	step = spi_hid_schedule_recovery(shid, SPI_HID_RECOVERY_RESYNC);
+	if (step != SPI_HID_RECOVERY_RESYNC)
+		return err;
+
+	shid->input_stage = SPI_HID_INPUT_STAGE_IDLE;
+
+	return spi_hid_input_async(shid, shid->input.header,
+			sizeof(shid->input.header),
+			spi_hid_input_header_complete);
+}
+
 static void spi_hid_input_body_complete(void *_shid)
 {
 	struct spi_hid *shid = _shid;
@@ -1512,21 +3262,30 @@ static void spi_hid_input_body_complete(void *_shid)
 	if (!shid->powered)
 		goto out;
 
-	trace_spi_hid_input_body_complete(shid,
-			shid->input_transfer[0].tx_buf,
+	trace_spi_hid_input_body_complete_hdr(shid,
 			shid->input_transfer[0].len,
-			shid->input_transfer[1].rx_buf,
 			shid->input_transfer[1].len,
+			(shid->input.header[0] >> 4) & 0xf,
+			((u8 *)shid->input_transfer[1].rx_buf)[2],
 			shid->input_message.status);
+	if (shid->trace_payload)
+		trace_spi_hid_input_body_complete(shid,
+				shid->input_transfer[0].tx_buf,
+				shid->input_transfer[0].len,
+				shid->input_transfer[1].rx_buf,
+				shid->input_transfer[1].len,
+				shid->input_message.status);
 
 	shid->input_stage = SPI_HID_INPUT_STAGE_IDLE;
+	shid->lat_body_ns = ktime_get_ns();
 
 	if (shid->input_message.status < 0) {
-		dev_warn(dev, "error reading body, resetting %d\n",
+		dev_warn(dev, "error reading body, recovering %d\n",
 				shid->input_message.status);
-		shid->bus_error_count++;
+		spi_hid_stat_inc(shid, SPI_HID_STAT_BUS_ERRORS);
 		shid->bus_last_error = shid->input_message.status;
-		schedule_work(&shid->error_work);
+		if (spi_hid_input_recover(shid, shid->input_message.status))
+			shid->input_transfer_pending = 0;
 		goto out;
 	}
 
@@ -1536,6 +3295,9 @@ static void spi_hid_input_body_complete(void *_shid)
 		goto out;
 	}
 
+	spi_hid_lat_record(shid, SPI_HID_LAT_BODY, shid->lat_submit_ns,
+			shid->lat_body_ns);
+
 	spi_hid_populate_input_header(shid->input.header, &header);
 	buf = &shid->input;
 	if (header.report_type == SPI_HID_REPORT_TYPE_COMMAND_RESP ||
@@ -1544,10 +3306,14 @@ static void spi_hid_input_body_complete(void *_shid)
 			buf = &shid->response;
 	}
 
+	spi_hid_capture(shid, SPI_HID_CAP_INPUT, shid->input.header,
+			SPI_HID_INPUT_HEADER_LEN, buf->body, header.report_length);
+
 	ret = spi_hid_process_input_report(shid, buf);
 	if (ret) {
 		dev_err(dev, "failed input callback: %d\n", ret);
-		schedule_work(&shid->error_work);
+		if (spi_hid_input_recover(shid, ret))
+			shid->input_transfer_pending = 0;
 		goto out;
 	}
 
@@ -1562,6 +3328,10 @@ static void spi_hid_input_body_complete(void *_shid)
 				spi_hid_input_header_complete);
 		if (ret)
 			dev_err(dev, "failed to start header --> %d\n", ret);
+		else
+			spi_hid_lat_record(shid, SPI_HID_LAT_IRQ_TO_HEADER,
+					shid->interrupt_time_stamps[0],
+					shid->lat_submit_ns);
 	}
 
 out:
@@ -1581,19 +3351,26 @@ static void spi_hid_input_header_complete(void *_shid)
 	if (!shid->powered)
 		goto out;
 
-	trace_spi_hid_input_header_complete(shid,
-			shid->input_transfer[0].tx_buf,
+	shid->lat_header_ns = ktime_get_ns();
+	trace_spi_hid_input_header_complete_hdr(shid,
 			shid->input_transfer[0].len,
-			shid->input_transfer[1].rx_buf,
 			shid->input_transfer[1].len,
+			(shid->input.header[0] >> 4) & 0xf, 0,
 			shid->input_message.status);
+	if (shid->trace_payload)
+		trace_spi_hid_input_header_complete(shid,
+				shid->input_transfer[0].tx_buf,
+				shid->input_transfer[0].len,
+				shid->input_transfer[1].rx_buf,
+				shid->input_transfer[1].len,
+				shid->input_message.status);
 
 	if (shid->input_message.status < 0) {
-		dev_warn(dev, "error reading header, resetting %d\n",
+		dev_warn(dev, "error reading header, recovering %d\n",
 				shid->input_message.status);
-		shid->bus_error_count++;
+		spi_hid_stat_inc(shid, SPI_HID_STAT_BUS_ERRORS);
 		shid->bus_last_error = shid->input_message.status;
-		schedule_work(&shid->error_work);
+		ret = spi_hid_input_recover(shid, shid->input_message.status);
 		goto out;
 	}
 
@@ -1603,6 +3380,9 @@ static void spi_hid_input_header_complete(void *_shid)
 		goto out;
 	}
 
+	spi_hid_lat_record(shid, SPI_HID_LAT_HEADER, shid->lat_submit_ns,
+			shid->lat_header_ns);
+
 	spi_hid_populate_input_header(shid->input.header, &header);
 
 	dev_err(dev, "read header: version=0x%02x, report_type=0x%02x, report_length=%u, fragment_id=0x%02x, sync_const=0x%02x\n",
@@ -1616,8 +3396,9 @@ static void spi_hid_input_header_complete(void *_shid)
 						shid->input.header,
 						sizeof(shid->input.header),
 						false);
-		shid->bus_error_count++;
+		spi_hid_stat_inc(shid, SPI_HID_STAT_BUS_ERRORS);
 		shid->bus_last_error = ret;
+		ret = spi_hid_input_recover(shid, ret);
 		goto out;
 	}
 
@@ -1636,6 +3417,9 @@ static void spi_hid_input_header_complete(void *_shid)
 			spi_hid_input_body_complete);
 	if (ret)
 		dev_err(dev, "failed body async transfer: %d\n", ret);
+	else
+		spi_hid_lat_record(shid, SPI_HID_LAT_HEADER_TO_BODY,
+				shid->lat_header_ns, shid->lat_submit_ns);
 
 out:
 	if (ret)
@@ -1644,14 +3428,124 @@ out:
 	spin_unlock_irqrestore(&shid->input_lock, flags);
 }
 
+/*
+* Feeds one captured data report through the same header validation,
+* parsing and report handling as a body read. Responses and resets are not
+* replayed, they would drive the live request and reset state. The input
+* buffers are only borrowed between transfers.
+*/
+static int spi_hid_replay_input(struct spi_hid *shid,
+		const struct spi_hid_cap_rec *rec)
+{
+	struct spi_hid_input_header header;
+	struct spi_hid_input_buf *buf;
+	u32 body_len = rec->len - rec->hdr_len;
+	unsigned long flags;
+	int ret;
+
+	if (rec->hdr_len != SPI_HID_INPUT_HEADER_LEN ||
+			body_len > sizeof(buf->body) + sizeof(buf->content))
+		return -EINVAL;
+
+	spi_hid_populate_input_header((u8 *)rec->data, &header);
+	if (header.report_type != SPI_HID_REPORT_TYPE_DATA)
+		return 0;
+
+	/* The body read would have been exactly report_length bytes */
+	if (header.report_length != body_len)
+		return -EINVAL;
+
+	spin_lock_irqsave(&shid->input_lock, flags);
+	if (shid->input_transfer_pending ||
+			shid->input_stage != SPI_HID_INPUT_STAGE_IDLE) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	ret = spi_hid_bus_validate_header(shid, &header);
+	if (ret)
+		goto out;
+
+	buf = &shid->input;
+
+	/* body and content are contiguous, as for a body read */
+	memcpy(buf->header, rec->data, SPI_HID_INPUT_HEADER_LEN);
+	memcpy(buf->body, rec->data + SPI_HID_INPUT_HEADER_LEN, body_len);
+
+	shid->interrupt_time_stamps[0] = ktime_get_ns();
+	shid->lat_body_ns = shid->interrupt_time_stamps[0];
+
+	ret = spi_hid_process_input_report(shid, buf);
+	if (!ret)
+		shid->replay_count++;
+
+out:
+	spin_unlock_irqrestore(&shid->input_lock, flags);
+
+	return ret;
+}
+
+/*
+* Takes whole capture records, data inputs are replayed and everything else
+* is skipped. A trailing partial record is left for the next write.
+*/
+static ssize_t spi_hid_replay_write(struct file *file,
+		const char __user *ubuf, size_t count, loff_t *ppos)
+{
+	struct spi_hid *shid = file->private_data;
+	struct spi_hid_cap_rec *rec;
+	size_t pos = 0;
+	void *data;
+	int ret = 0;
+
+	if (count > SPI_HID_REPLAY_MAX_WRITE)
+		count = SPI_HID_REPLAY_MAX_WRITE;
+
+	data = memdup_user(ubuf, count);
+	if (IS_ERR(data))
+		return PTR_ERR(data);
+
+	while (count - pos >= sizeof(*rec)) {
+		rec = data + pos;
+		if (rec->magic != SPI_HID_CAP_MAGIC ||
+				rec->version != SPI_HID_CAP_VERSION ||
+				rec->size < SPI_HID_CAP_REC_SIZE(rec->len) ||
+				rec->hdr_len > rec->len) {
+			ret = -EINVAL;
+			break;
+		}
+		if (rec->size > count - pos)
+			break;
+
+		if (rec->type == SPI_HID_CAP_INPUT) {
+			ret = spi_hid_replay_input(shid, rec);
+			if (ret)
+				break;
+		}
+		pos += rec->size;
+	}
+
+	kfree(data);
+
+	return pos ? pos : ret;
+}
+
+static const struct file_operations spi_hid_replay_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.write = spi_hid_replay_write,
+};
+
 static int spi_hid_bus_input_report(struct spi_hid *shid)
 {
 	struct device *dev = &shid->spi->dev;
 	int ret;
 
 	trace_spi_hid_bus_input_report(shid);
-	if (shid->input_transfer_pending++)
+	if (shid->input_transfer_pending++) {
+		spi_hid_stat_inc(shid, SPI_HID_STAT_IRQS_COALESCED);
 		return 0;
+	}
 
 	ret = spi_hid_input_async(shid, shid->input.header,
 			sizeof(shid->input.header),
@@ -1661,6 +3555,9 @@ static int spi_hid_bus_input_report(struct spi_hid *shid)
 		return ret;
 	}
 
+	spi_hid_lat_record(shid, SPI_HID_LAT_IRQ_TO_HEADER,
+			shid->interrupt_time_stamps[0], shid->lat_submit_ns);
+
 	return 0;
 }
 
@@ -1668,6 +3565,8 @@ static int spi_hid_assert_reset(struct spi_hid *shid)
 {
 	int ret;
 
+	spi_hid_reset_timing_start(shid);
+
 	if (!shid->spi->dev.of_node)
 		return 0;
 
@@ -1685,16 +3584,27 @@ static int spi_hid_deassert_reset(struct spi_hid *shid)
 {
 	int ret;
 
-	if (!shid->spi->dev.of_node)
-		return spi_hid_reset_via_acpi(shid);
+	if (!shid->spi->dev.of_node) {
+		ret = spi_hid_reset_via_acpi(shid);
+		if (ret)
+			return ret;
+
+		spi_hid_wait_for_reset_response(shid);
+		return 0;
+	}
 
+	reinit_completion(&shid->reset_response);
 	ret = pinctrl_select_state(shid->pinctrl, shid->pinctrl_active);
 	if (ret)
 		return ret;
 
+	spi_hid_reset_mark(shid, SPI_HID_RESET_PHASE_ASSERT);
+
 	/* Let VREG_S10B_1P8V stabilize */
 	usleep_range(5000, 6000);
 
+	spi_hid_wait_for_reset_response(shid);
+
 	return 0;
 }
 
@@ -1711,7 +3621,7 @@ static int spi_hid_power_up(struct spi_hid *shid)
 	if (shid->spi->dev.of_node) {
 		ret = regulator_enable(shid->supply);
 		if (ret) {
-			shid->regulator_error_count++;
+			spi_hid_stat_inc(shid, SPI_HID_STAT_REGULATOR_ERRORS);
 			shid->regulator_last_error = ret;
 			goto err0;
 		}
@@ -1728,7 +3638,8 @@ err0:
 	return ret;
 }
 
-static int spi_hid_get_request(struct spi_hid *shid, u8 content_id)
+static int spi_hid_get_request(struct spi_hid *shid, u8 content_id,
+		u8 *buf, u16 len)
 {
 	struct spi_hid_output_report report = {
 		.content_type = SPI_HID_CONTENT_TYPE_GET_FEATURE,
@@ -1739,7 +3650,7 @@ static int spi_hid_get_request(struct spi_hid *shid, u8 content_id)
 
 
 	return spi_hid_sync_request(shid, shid->desc.output_register,
-			&report);
+			&report, buf, len);
 }
 
 static int spi_hid_set_request(struct spi_hid *shid,
@@ -1753,19 +3664,46 @@ static int spi_hid_set_request(struct spi_hid *shid,
 	};
 
 
-	return spi_hid_send_output_report(shid,
-			shid->desc.output_register, &report);
+	return spi_hid_sync_request(shid, shid->desc.output_register,
+			&report, NULL, 0);
 }
 
-static irqreturn_t spi_hid_dev_irq(int irq, void *_shid)
+static int spi_hid_set_power(struct spi_hid *shid, u8 power_state)
 {
-	struct spi_hid *shid = _shid;
-	struct device *dev = &shid->spi->dev;
-	int ret = 0;
-	static int irq_count = 0;
+	struct spi_hid_output_report report = {
+		.content_type = SPI_HID_CONTENT_TYPE_COMMAND,
+		.content_length = 1 + 3,
+		.content_id = SPI_HID_COMMAND_SET_POWER,
+		.content = &power_state,
+	};
+	u8 response;
+	int ret;
+
+	if (shid->desc.device_power_support == SPI_HID_POWER_SUPPORT_RESP)
+		ret = spi_hid_sync_request(shid, shid->desc.output_register,
+				&report, &response, sizeof(response));
+	else
+		ret = spi_hid_sync_request(shid, shid->desc.output_register,
+				&report, NULL, 0);
+	if (ret < 0)
+		return ret;
+
+	if (shid->desc.power_response_delay)
+		msleep(shid->desc.power_response_delay);
+
+	return 0;
+}
+
+static irqreturn_t spi_hid_dev_irq(int irq, void *_shid)
+{
+	struct spi_hid *shid = _shid;
+	struct device *dev = &shid->spi->dev;
+	int ret = 0;
+	static int irq_count = 0;
 
 	spin_lock(&shid->input_lock);
 	trace_spi_hid_dev_irq(shid, irq);
+	spi_hid_stat_inc(shid, SPI_HID_STAT_IRQS);
 
 	/* MSHW0231: Log interrupt activity for debugging */
 	irq_count++;
@@ -1775,6 +3713,15 @@ static irqreturn_t spi_hid_dev_irq(int irq, void *_shid)
 	}
 
 	shid->interrupt_time_stamps[shid->input_transfer_pending] = ktime_get_ns();
+	spi_hid_windows_stage_event(shid, MSHW0231_STAGE_EVENT_IRQ);
+
+	/* SPI_HID_DEV_EVENT_WAKEUP: the host has to bring a sleeping device back */
+	if (shid->power_state == SPI_HID_POWER_MODE_SLEEP) {
+		if (shid->idle_sleeping)
+			spi_hid_queue_work(shid, &shid->idle_wake_work);
+		else
+			pm_request_resume(dev);
+	}
 
 	ret = spi_hid_bus_input_report(shid);
 
@@ -1783,7 +3730,8 @@ static irqreturn_t spi_hid_dev_irq(int irq, void *_shid)
 			dev_warn(dev, "MSHW0231: Input transaction failed in IRQ: %d (IRQ count: %d)\n", 
 				ret, irq_count);
 		}
-		schedule_work(&shid->error_work);
+		if (spi_hid_input_recover(shid, ret))
+			shid->input_transfer_pending = 0;
 	} else {
 		if (irq_count % 50 == 1) {
 			dev_info(dev, "MSHW0231: SPI read successful in IRQ context (count: %d)\n", irq_count);
@@ -1815,15 +3763,14 @@ static void spi_hid_ll_stop(struct hid_device *hid)
 	hid->claimed = 0;
 }
 
-static int spi_hid_ll_open(struct hid_device *hid)
+/* Full bring-up from SPI_HID_POWER_MODE_OFF */
+static int spi_hid_power_on(struct spi_hid *shid)
 {
-	struct spi_device *spi = hid->driver_data;
-	struct spi_hid *shid = spi_get_drvdata(spi);
-	struct device *dev = &spi->dev;
+	struct device *dev = &shid->spi->dev;
 	u8 prev_state = shid->power_state;
 	int ret;
 
-	if (shid->refresh_in_progress || prev_state == SPI_HID_POWER_MODE_ACTIVE)
+	if (prev_state == SPI_HID_POWER_MODE_ACTIVE)
 		return 0;
 
 	ret = spi_hid_assert_reset(shid);
@@ -1839,7 +3786,7 @@ static int spi_hid_ll_open(struct hid_device *hid)
 	} else {
 		dev_err(dev, "%s called with interrupt already enabled\n",
 								__func__);
-		shid->logic_error_count++;
+		spi_hid_stat_inc(shid, SPI_HID_STAT_LOGIC_ERRORS);
 		shid->logic_last_error = -EEXIST;
 	}
 
@@ -1873,32 +3820,32 @@ err0:
 	return ret;
 }
 
-static void spi_hid_ll_close(struct hid_device *hid)
+static void spi_hid_power_off(struct spi_hid *shid)
 {
-	struct spi_device *spi = hid->driver_data;
-	struct spi_hid *shid = spi_get_drvdata(spi);
-	struct device *dev = &spi->dev;
-	u8 prev_state = shid->power_state;
+	struct device *dev = &shid->spi->dev;
+	u8 prev_state;
 	int ret;
 
-	if (shid->refresh_in_progress || prev_state == SPI_HID_POWER_MODE_OFF)
-		return;
-
 	mutex_lock(&shid->power_lock);
 
+	prev_state = shid->power_state;
+	if (prev_state == SPI_HID_POWER_MODE_OFF)
+		goto out;
+
 	if (shid->irq_enabled) {
 		disable_irq(shid->irq);
 		shid->irq_enabled = false;
 	} else {
 		dev_err(dev, "%s called with interrupt already disabled\n",
 								__func__);
-		shid->logic_error_count++;
+		spi_hid_stat_inc(shid, SPI_HID_STAT_LOGIC_ERRORS);
 		shid->logic_last_error = -ENOEXEC;
 	}
 
 	shid->ready = false;
 	sysfs_notify(&dev->kobj, NULL, "ready");
 	shid->attempts = 0;
+	cancel_delayed_work(&shid->wd_work);
 	ret = spi_hid_power_down(shid);
 	if (ret) {
 		dev_err(dev, "%s: could not power down\n", __func__);
@@ -1914,6 +3861,156 @@ out:
 	mutex_unlock(&shid->power_lock);
 }
 
+/* Called with power_lock held */
+static void spi_hid_idle_set_sleeping(struct spi_hid *shid, bool sleeping)
+{
+	ktime_t now = ktime_get();
+
+	shid->idle_residency_ns[shid->idle_sleeping] +=
+			ktime_to_ns(ktime_sub(now, shid->idle_since));
+	shid->idle_since = now;
+	shid->idle_sleeping = sleeping;
+}
+
+static void spi_hid_idle_work(struct work_struct *work)
+{
+	struct spi_hid *shid = container_of(to_delayed_work(work),
+			struct spi_hid, idle_work);
+	struct device *dev = &shid->spi->dev;
+	int ret;
+
+	mutex_lock(&shid->power_lock);
+
+	if (shid->power_state != SPI_HID_POWER_MODE_ACTIVE || !shid->ready ||
+		shid->desc.device_power_support == SPI_HID_POWER_SUPPORT_NONE)
+		goto out;
+
+	/* spi_hid_set_power() waits out power_response_delay */
+	ret = spi_hid_set_power(shid, SPI_HID_POWER_MODE_SLEEP);
+	if (ret) {
+		dev_err(dev, "%s: failed to enter sleep: %d\n", __func__, ret);
+		goto out;
+	}
+
+	shid->power_state = SPI_HID_POWER_MODE_SLEEP;
+	spi_hid_idle_set_sleeping(shid, true);
+	shid->idle_sleeps++;
+
+out:
+	mutex_unlock(&shid->power_lock);
+}
+
+static void spi_hid_idle_wake_work(struct work_struct *work)
+{
+	struct spi_hid *shid =
+		container_of(work, struct spi_hid, idle_wake_work);
+	struct device *dev = &shid->spi->dev;
+	int ret;
+
+	mutex_lock(&shid->power_lock);
+
+	if (!shid->idle_sleeping) {
+		mutex_unlock(&shid->power_lock);
+		return;
+	}
+
+	ret = spi_hid_set_power(shid, SPI_HID_POWER_MODE_ACTIVE);
+
+	shid->power_state = SPI_HID_POWER_MODE_ACTIVE;
+	spi_hid_idle_set_sleeping(shid, false);
+	shid->idle_wakes++;
+
+	mutex_unlock(&shid->power_lock);
+
+	if (ret) {
+		dev_err(dev, "%s: failed to wake: %d\n", __func__, ret);
+		spi_hid_schedule_recovery(shid, SPI_HID_RECOVERY_HARD_RESET);
+		return;
+	}
+
+	spi_hid_idle_activity(shid);
+}
+
+/* Hands a governor sleep over to runtime or system PM */
+static void spi_hid_idle_stop(struct spi_hid *shid)
+{
+	cancel_delayed_work_sync(&shid->idle_work);
+	cancel_work_sync(&shid->idle_wake_work);
+
+	mutex_lock(&shid->power_lock);
+	if (shid->idle_sleeping)
+		spi_hid_idle_set_sleeping(shid, false);
+	mutex_unlock(&shid->power_lock);
+}
+
+static void spi_hid_off_work(struct work_struct *work)
+{
+	struct spi_hid *shid =
+		container_of(to_delayed_work(work), struct spi_hid, off_work);
+
+	if (shid->power_state == SPI_HID_POWER_MODE_SLEEP)
+		spi_hid_power_off(shid);
+}
+
+static void spi_hid_grace_work(struct work_struct *work)
+{
+	struct spi_hid *shid =
+		container_of(to_delayed_work(work), struct spi_hid, grace_work);
+	struct device *dev = &shid->spi->dev;
+
+	dev_err(dev, "%s: not opened within %u ms\n", __func__,
+			shid->open_grace_ms);
+	shid->grace_misses++;
+	shid->pm_bringup_ref = false;
+	pm_runtime_mark_last_busy(dev);
+	pm_runtime_put_autosuspend(dev);
+}
+
+static int spi_hid_ll_open(struct hid_device *hid)
+{
+	struct spi_device *spi = hid->driver_data;
+	struct spi_hid *shid = spi_get_drvdata(spi);
+	int ret;
+
+	spi_hid_timeline_mark(shid, SPI_HID_TL_LL_OPEN);
+
+	if (shid->refresh_in_progress || shid->pm_open_ref)
+		return 0;
+
+	/* Opened within the grace window, the bring-up reference is ours */
+	if (cancel_delayed_work_sync(&shid->grace_work)) {
+		dev_err(&spi->dev, "%s: device still up, skipping power cycle\n",
+				__func__);
+		shid->grace_hits++;
+		shid->pm_bringup_ref = false;
+		shid->pm_open_ref = true;
+		spi_hid_idle_activity(shid);
+		return 0;
+	}
+
+	ret = pm_runtime_resume_and_get(&spi->dev);
+	if (ret)
+		return ret;
+
+	shid->pm_open_ref = true;
+	spi_hid_idle_activity(shid);
+
+	return 0;
+}
+
+static void spi_hid_ll_close(struct hid_device *hid)
+{
+	struct spi_device *spi = hid->driver_data;
+	struct spi_hid *shid = spi_get_drvdata(spi);
+
+	if (shid->refresh_in_progress || !shid->pm_open_ref)
+		return;
+
+	shid->pm_open_ref = false;
+	pm_runtime_mark_last_busy(&spi->dev);
+	pm_runtime_put_autosuspend(&spi->dev);
+}
+
 static int spi_hid_ll_power(struct hid_device *hid, int level)
 {
 	struct spi_device *spi = hid->driver_data;
@@ -1933,9 +4030,14 @@ static int spi_hid_ll_parse(struct hid_device *hid)
 	struct spi_device *spi = hid->driver_data;
 	struct spi_hid *shid = spi_get_drvdata(spi);
 	struct device *dev = &spi->dev;
+	u8 *descriptor;
 	int ret, len;
 
-	mutex_lock(&shid->lock);
+	spi_hid_timeline_mark(shid, SPI_HID_TL_LL_PARSE);
+
+	descriptor = kzalloc(SPI_HID_MAX_REPORT_DESC_LEN, GFP_KERNEL);
+	if (!descriptor)
+		return -ENOMEM;
 
 	/* MSHW0231: Skip blocking descriptor request to prevent system lockup */
 	if (spi_hid_is_mshw0231(shid)) {
@@ -1976,43 +4078,52 @@ static int spi_hid_ll_parse(struct hid_device *hid)
 		};
 		
 		len = sizeof(touchscreen_descriptor);
-		memcpy(shid->response.content, touchscreen_descriptor, len);
+		memcpy(descriptor, touchscreen_descriptor, len);
 		dev_info(dev, "MSHW0231: Using Collection 06 touchscreen descriptor (len=%d)\n", len);
 	} else {
-		len = spi_hid_report_descriptor_request(shid);
+		len = spi_hid_desc_cache_lookup(shid, descriptor,
+				SPI_HID_MAX_REPORT_DESC_LEN);
 		if (len < 0) {
-			dev_err(dev, "Report descriptor request failed, %d\n", len);
-			ret = len;
-			goto out;
+			len = spi_hid_report_descriptor_request(shid, descriptor,
+					SPI_HID_MAX_REPORT_DESC_LEN);
+			if (len < 0) {
+				dev_err(dev, "Report descriptor request failed, %d\n",
+						len);
+				ret = len;
+				goto out;
+			}
+			spi_hid_desc_cache_store(shid, descriptor, len);
 		}
 	}
 
+	spi_hid_timeline_mark(shid, SPI_HID_TL_REPORT_DESC);
+
 	/*
 	* MSHW0231 Multi-Collection HID Parsing
 	* This device creates 8 HID collections, Collection 06 is the touchscreen
 	*/
 	if (spi_hid_is_mshw0231(shid)) {
 		dev_info(dev, "MSHW0231: Parsing multi-collection HID descriptor\n");
-		ret = spi_hid_parse_mshw0231_collections(shid, hid, (__u8 *) shid->response.content, len);
+		ret = spi_hid_parse_mshw0231_collections(shid, hid, descriptor, len);
 		if (ret) {
 			dev_err(dev, "MSHW0231: Multi-collection parsing failed: %d\n", ret);
 			/* Fall back to standard parsing */
-			ret = hid_parse_report(hid, (__u8 *) shid->response.content, len);
+			ret = hid_parse_report(hid, descriptor, len);
 		}
 	} else {
 		/* Standard HID parsing for other devices */
-		ret = hid_parse_report(hid, (__u8 *) shid->response.content, len);
+		ret = hid_parse_report(hid, descriptor, len);
 	}
 	
 	if (ret)
 		dev_err(dev, "failed parsing report: %d\n", ret);
 	else
 		shid->report_descriptor_crc32 = crc32_le(0,
-					(unsigned char const *)  shid->response.content,
+					(unsigned char const *) descriptor,
 					len);
 
 out:
-	mutex_unlock(&shid->lock);
+	kfree(descriptor);
 
 	return ret;
 }
@@ -2031,8 +4142,6 @@ static int spi_hid_ll_raw_request(struct hid_device *hid,
 		return -ENODEV;
 	}
 
-	mutex_lock(&shid->lock);
-
 	switch (reqtype) {
 	case HID_REQ_SET_REPORT:
 		if (buf[0] != reportnum) {
@@ -2051,23 +4160,16 @@ static int spi_hid_ll_raw_request(struct hid_device *hid,
 		ret = len;
 		break;
 	case HID_REQ_GET_REPORT:
-		ret = spi_hid_get_request(shid, reportnum);
-		if (ret) {
+		ret = spi_hid_get_request(shid, reportnum, buf,
+				min_t(size_t, len, U16_MAX));
+		if (ret < 0)
 			dev_err(dev, "failed to get report\n");
-			break;
-		}
-
-		ret = min_t(size_t, len,
-			(shid->response.body[0] | (shid->response.body[1] << 8)) - 3);
-		memcpy(buf, &shid->response.content, ret);
 		break;
 	default:
 		dev_err(dev, "invalid request type\n");
 		ret = -EIO;
 	}
 
-	mutex_unlock(&shid->lock);
-
 	return ret;
 }
 
@@ -2085,20 +4187,18 @@ static int spi_hid_ll_output_report(struct hid_device *hid,
 		.content = &buf[1],
 	};
 
-	mutex_lock(&shid->lock);
 	if (!shid->ready) {
 		dev_err(dev, "%s called in unready state\n", __func__);
 		ret = -ENODEV;
 		goto out;
 	}
 
-	ret = spi_hid_send_output_report(shid, shid->desc.output_register, &report);
+	ret = spi_hid_sync_request(shid, shid->desc.output_register, &report,
+			NULL, 0);
 	if (ret)
 		dev_err(dev, "failed to send output report\n");
 
 out:
-	mutex_unlock(&shid->lock);
-
 	if (ret > 0)
 		return -ret;
 
@@ -2150,8 +4250,9 @@ static ssize_t bus_error_count_show(struct device *dev,
 {
 	struct spi_hid *shid = dev_get_drvdata(dev);
 
-	return snprintf(buf, PAGE_SIZE, "%d (%d)\n",
-			shid->bus_error_count, shid->bus_last_error);
+	return snprintf(buf, PAGE_SIZE, "%llu (%d)\n",
+			spi_hid_stat_sum(shid, SPI_HID_STAT_BUS_ERRORS),
+			shid->bus_last_error);
 }
 static DEVICE_ATTR_RO(bus_error_count);
 
@@ -2160,8 +4261,8 @@ static ssize_t regulator_error_count_show(struct device *dev,
 {
 	struct spi_hid *shid = dev_get_drvdata(dev);
 
-	return snprintf(buf, PAGE_SIZE, "%d (%d)\n",
-			shid->regulator_error_count,
+	return snprintf(buf, PAGE_SIZE, "%llu (%d)\n",
+			spi_hid_stat_sum(shid, SPI_HID_STAT_REGULATOR_ERRORS),
 			shid->regulator_last_error);
 }
 static DEVICE_ATTR_RO(regulator_error_count);
@@ -2171,128 +4272,845 @@ static ssize_t device_initiated_reset_count_show(struct device *dev,
 {
 	struct spi_hid *shid = dev_get_drvdata(dev);
 
-	return snprintf(buf, PAGE_SIZE, "%d\n", shid->dir_count);
+	return snprintf(buf, PAGE_SIZE, "%llu\n",
+			spi_hid_stat_sum(shid, SPI_HID_STAT_DEVICE_RESETS));
 }
 static DEVICE_ATTR_RO(device_initiated_reset_count);
 
-static ssize_t logic_error_count_show(struct device *dev,
-		struct device_attribute *attr, char *buf)
-{
-	struct spi_hid *shid = dev_get_drvdata(dev);
+static ssize_t logic_error_count_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%llu (%d)\n",
+			spi_hid_stat_sum(shid, SPI_HID_STAT_LOGIC_ERRORS),
+			shid->logic_last_error);
+}
+static DEVICE_ATTR_RO(logic_error_count);
+
+static ssize_t recovery_count_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "resync %u protocol %u hard %u coalesced %u\n",
+			shid->recovery_count[SPI_HID_RECOVERY_RESYNC],
+			shid->recovery_count[SPI_HID_RECOVERY_PROTOCOL_RESET],
+			shid->recovery_count[SPI_HID_RECOVERY_HARD_RESET],
+			shid->recovery_coalesced);
+}
+static DEVICE_ATTR_RO(recovery_count);
+
+static ssize_t reset_timing_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+	int count = 0;
+	int i;
+
+	count += scnprintf(buf + count, PAGE_SIZE - count,
+			"resets %u attempts %u\n", shid->reset_timing_count,
+			shid->attempts);
+
+	for (i = 0; i < SPI_HID_RESET_PHASES; i++)
+		count += scnprintf(buf + count, PAGE_SIZE - count,
+				"%s last_us %llu max_us %llu\n",
+				spi_hid_reset_phase_names[i],
+				shid->reset_phase_last_us[i],
+				shid->reset_phase_max_us[i]);
+
+	return count;
+}
+static DEVICE_ATTR_RO(reset_timing);
+
+static ssize_t descriptor_cache_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+	struct spi_hid_desc_cache *cache = &shid->desc_cache;
+	ssize_t ret;
+
+	mutex_lock(&cache->lock);
+	ret = snprintf(buf, PAGE_SIZE,
+			"valid %d id %04x:%04x v%u len %u crc %08x hits %u misses %u stale %u\n",
+			cache->valid, cache->desc.vendor_id,
+			cache->desc.product_id, cache->desc.version_id,
+			cache->report_desc_len, cache->crc32, cache->hits,
+			cache->misses, cache->stale);
+	mutex_unlock(&cache->lock);
+
+	return ret;
+}
+static DEVICE_ATTR_RO(descriptor_cache);
+
+static ssize_t
+spi_hid_latency_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+	int count = 0;
+	int i = 0;
+
+	for (i = 0; i < SPI_HID_MAX_LATENCIES; i++) {
+		if (shid->latencies[i].report_id == 0)
+			break;
+
+		count += scnprintf(buf + count, PAGE_SIZE - count, "%u %u %llu %llu|",
+					shid->latencies[i].report_id,
+					shid->latencies[i].signature,
+					shid->latencies[i].start_time,
+					shid->latencies[i].end_time);
+	}
+
+	return count;
+}
+static DEVICE_ATTR_RO(spi_hid_latency);
+
+static ssize_t
+spi_hid_perf_mode_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+	int count = 0;
+
+	count += snprintf(buf, PAGE_SIZE, "%d", shid->perf_mode);
+
+	return count;
+}
+
+static ssize_t
+spi_hid_perf_mode_store(struct device *dev,
+			struct device_attribute *attr,
+			const char *buf,
+			size_t size)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+	unsigned long flags;
+
+	spin_lock_irqsave(&shid->input_lock, flags);
+	if (kstrtou8(buf, 10, &shid->perf_mode))
+		return -EINVAL;
+
+	// Reset the log
+	if (shid->perf_mode) {
+		memset(shid->latencies, 0, sizeof(shid->latencies));
+		shid->latency_index = 0;
+	}
+
+	spin_unlock_irqrestore(&shid->input_lock, flags);
+
+	return size;
+}
+
+static DEVICE_ATTR_RW(spi_hid_perf_mode);
+
+static ssize_t spi_hid_lowlat_mode_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%d %s engaged %u\n",
+			shid->lowlat_mode,
+			shid->lowlat_active ? "active" : "idle",
+			shid->lowlat_engaged_count);
+}
+
+static ssize_t spi_hid_lowlat_mode_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t size)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+	bool mode;
+
+	if (kstrtobool(buf, &mode))
+		return -EINVAL;
+
+	shid->lowlat_mode = mode;
+	if (!mode)
+		spi_hid_lowlat_stop(shid);
+
+	return size;
+}
+static DEVICE_ATTR_RW(spi_hid_lowlat_mode);
+
+static ssize_t spi_hid_lowlat_cpu_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%d\n", shid->lowlat_cpu);
+}
+
+static ssize_t spi_hid_lowlat_cpu_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t size)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+	int cpu;
+
+	if (kstrtoint(buf, 10, &cpu) || cpu < -1 || cpu >= nr_cpu_ids)
+		return -EINVAL;
+
+	/* Takes effect the next time the mode engages */
+	mutex_lock(&shid->lowlat_lock);
+	spi_hid_lowlat_release(shid);
+	shid->lowlat_cpu = cpu;
+	mutex_unlock(&shid->lowlat_lock);
+
+	return size;
+}
+static DEVICE_ATTR_RW(spi_hid_lowlat_cpu);
+
+static ssize_t spi_hid_lowlat_idle_ms_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%u\n", shid->lowlat_idle_ms);
+}
+
+static ssize_t spi_hid_lowlat_idle_ms_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t size)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+
+	if (kstrtou32(buf, 10, &shid->lowlat_idle_ms))
+		return -EINVAL;
+
+	return size;
+}
+static DEVICE_ATTR_RW(spi_hid_lowlat_idle_ms);
+
+static ssize_t spi_hid_lowlat_speed_hz_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%u\n", shid->lowlat_speed_hz);
+}
+
+static ssize_t spi_hid_lowlat_speed_hz_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t size)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+	u32 speed_hz;
+
+	if (kstrtou32(buf, 10, &speed_hz) || speed_hz > shid->spi->max_speed_hz)
+		return -EINVAL;
+
+	mutex_lock(&shid->lowlat_lock);
+	shid->lowlat_speed_hz = speed_hz;
+	spi_hid_clk_update(shid);
+	mutex_unlock(&shid->lowlat_lock);
+
+	return size;
+}
+static DEVICE_ATTR_RW(spi_hid_lowlat_speed_hz);
+
+static ssize_t spi_hid_clk_scaling_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+	u64 residency_ns[SPI_HID_CLK_RATES];
+	unsigned long flags;
+	int count = 0;
+
+	spin_lock_irqsave(&shid->clk_lock, flags);
+	memcpy(residency_ns, shid->clk_residency_ns, sizeof(residency_ns));
+	residency_ns[shid->clk_state] +=
+			ktime_to_ns(ktime_sub(ktime_get(), shid->clk_since));
+
+	count += scnprintf(buf + count, PAGE_SIZE - count,
+			"idle_hz %u active_hz %u up_reports %u idle_ms %u\n",
+			shid->clk_rate_hz[SPI_HID_CLK_IDLE],
+			shid->clk_rate_hz[SPI_HID_CLK_ACTIVE],
+			shid->clk_up_reports, shid->clk_idle_ms);
+	count += scnprintf(buf + count, PAGE_SIZE - count,
+			"state %s speed_hz %u switches %u\n",
+			shid->clk_state == SPI_HID_CLK_ACTIVE ? "active" : "idle",
+			shid->xfer_speed_hz, shid->clk_switches);
+	spin_unlock_irqrestore(&shid->clk_lock, flags);
+
+	count += scnprintf(buf + count, PAGE_SIZE - count,
+			"residency_ms idle %llu active %llu\n",
+			div_u64(residency_ns[SPI_HID_CLK_IDLE], NSEC_PER_MSEC),
+			div_u64(residency_ns[SPI_HID_CLK_ACTIVE], NSEC_PER_MSEC));
+
+	return count;
+}
+
+/* Takes "<idle_hz> <active_hz> <up_reports> <idle_ms>", 0 Hz is the default */
+static ssize_t spi_hid_clk_scaling_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t size)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+	u32 idle_hz, active_hz, up_reports, idle_ms;
+	u32 max_hz = shid->spi->max_speed_hz;
+	unsigned long flags;
+
+	if (sscanf(buf, "%u %u %u %u", &idle_hz, &active_hz, &up_reports,
+			&idle_ms) != 4 || !up_reports)
+		return -EINVAL;
+
+	/* Nothing faster than the controller allows or calibration passed */
+	if (shid->clk_cal_done && !shid->clk_cal_status)
+		max_hz = min(max_hz, shid->clk_cal_speed_hz);
+	if (idle_hz > max_hz || active_hz > max_hz)
+		return -EINVAL;
+
+	spin_lock_irqsave(&shid->clk_lock, flags);
+	shid->clk_rate_hz[SPI_HID_CLK_IDLE] = idle_hz;
+	shid->clk_rate_hz[SPI_HID_CLK_ACTIVE] = active_hz;
+	shid->clk_up_reports = up_reports;
+	shid->clk_idle_ms = idle_ms;
+	shid->clk_burst = 0;
+	spi_hid_clk_set_state(shid, SPI_HID_CLK_IDLE);
+	spin_unlock_irqrestore(&shid->clk_lock, flags);
+
+	return size;
+}
+static DEVICE_ATTR_RW(spi_hid_clk_scaling);
+
+static ssize_t spi_hid_watchdog_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+	int count = 0;
+
+	count += scnprintf(buf + count, PAGE_SIZE - count,
+			"timeout_ms %u slo_us %u slo_frames %u recover %d\n",
+			shid->wd_timeout_ms, shid->wd_slo_us,
+			shid->wd_slo_frames, shid->wd_recover);
+	count += scnprintf(buf + count, PAGE_SIZE - count,
+			"heartbeats %u interval_ms %u slo_streak %u\n",
+			shid->wd_heartbeats, shid->wd_hb_interval_ms,
+			shid->wd_slo_streak);
+	count += scnprintf(buf + count, PAGE_SIZE - count,
+			"alarms stall %u slo %u\n",
+			shid->wd_alarms[SPI_HID_WD_STALL],
+			shid->wd_alarms[SPI_HID_WD_SLO]);
+
+	return count;
+}
+
+/* Takes "<timeout_ms> <slo_us> <slo_frames> <recover>", 0 turns a check off */
+static ssize_t spi_hid_watchdog_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t size)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+	u32 timeout_ms, slo_us, slo_frames, recover;
+
+	if (sscanf(buf, "%u %u %u %u", &timeout_ms, &slo_us, &slo_frames,
+			&recover) != 4 || !slo_frames)
+		return -EINVAL;
+
+	if (!timeout_ms)
+		cancel_delayed_work_sync(&shid->wd_work);
+
+	shid->wd_timeout_ms = timeout_ms;
+	shid->wd_slo_us = slo_us;
+	shid->wd_slo_frames = slo_frames;
+	shid->wd_slo_streak = 0;
+	shid->wd_recover = recover;
+
+	return size;
+}
+static DEVICE_ATTR_RW(spi_hid_watchdog);
+
+static ssize_t spi_hid_clk_calibrate_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+	int count = 0;
+	int i;
+
+	count += scnprintf(buf + count, PAGE_SIZE - count,
+			"status %s %d reads %u speed_hz %u\n",
+			shid->clk_cal_done ? "done" : "none",
+			shid->clk_cal_status, shid->clk_cal_reads,
+			shid->clk_cal_speed_hz);
+
+	for (i = 0; i < SPI_HID_CLK_CAL_STEPS; i++) {
+		/* The sweep stops at the first failing rate */
+		if (SPI_HID_CLK_CAL_STEPS - i > shid->clk_cal_tested)
+			count += scnprintf(buf + count, PAGE_SIZE - count,
+					"%u hz untested\n",
+					spi_hid_clk_cal_hz[i]);
+		else
+			count += scnprintf(buf + count, PAGE_SIZE - count,
+					"%u hz errors %u\n",
+					spi_hid_clk_cal_hz[i],
+					shid->clk_cal_errors[i]);
+	}
+
+	return count;
+}
+
+/* Writing a number of reads per rate starts a calibration sweep */
+static ssize_t spi_hid_clk_calibrate_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t size)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+	u32 reads;
+
+	if (kstrtou32(buf, 10, &reads) || !reads)
+		return -EINVAL;
+
+	if (work_busy(&shid->clk_cal_work))
+		return -EBUSY;
+
+	shid->clk_cal_reads = reads;
+	spi_hid_queue_work(shid, &shid->clk_cal_work);
+
+	return size;
+}
+static DEVICE_ATTR_RW(spi_hid_clk_calibrate);
+
+static ssize_t off_delay_ms_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%u\n", shid->off_delay_ms);
+}
+
+static ssize_t off_delay_ms_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t size)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+
+	if (kstrtou32(buf, 10, &shid->off_delay_ms))
+		return -EINVAL;
+
+	return size;
+}
+static DEVICE_ATTR_RW(off_delay_ms);
+
+static ssize_t open_grace_ms_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%u (hits %u misses %u)\n",
+			shid->open_grace_ms, shid->grace_hits,
+			shid->grace_misses);
+}
+
+static ssize_t open_grace_ms_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t size)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+
+	if (kstrtou32(buf, 10, &shid->open_grace_ms))
+		return -EINVAL;
+
+	return size;
+}
+static DEVICE_ATTR_RW(open_grace_ms);
+
+static ssize_t spi_hid_wq_cpus_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%*pbl\n",
+			cpumask_pr_args(shid->wq_cpus));
+}
+
+static ssize_t spi_hid_wq_cpus_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t size)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+	cpumask_var_t cpus;
+	int ret;
+
+	if (!alloc_cpumask_var(&cpus, GFP_KERNEL))
+		return -ENOMEM;
+
+	ret = cpulist_parse(buf, cpus);
+	if (!ret && !cpumask_intersects(cpus, cpu_online_mask))
+		ret = -EINVAL;
+	if (!ret)
+		ret = spi_hid_wq_set_cpus(shid, cpus);
+	if (!ret)
+		cpumask_copy(shid->wq_cpus, cpus);
+
+	free_cpumask_var(cpus);
+
+	return ret ? ret : size;
+}
+static DEVICE_ATTR_RW(spi_hid_wq_cpus);
+
+static ssize_t spi_hid_trace_sample_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%u\n", shid->trace_sample);
+}
+
+static ssize_t spi_hid_trace_sample_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t size)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+	u32 n;
+
+	if (kstrtou32(buf, 10, &n))
+		return -EINVAL;
+
+	WRITE_ONCE(shid->trace_sample, n);
+
+	return size;
+}
+static DEVICE_ATTR_RW(spi_hid_trace_sample);
+
+static ssize_t spi_hid_idle_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+	u64 residency_ns[2];
+	bool sleeping;
+
+	mutex_lock(&shid->power_lock);
+	sleeping = shid->idle_sleeping;
+	memcpy(residency_ns, shid->idle_residency_ns, sizeof(residency_ns));
+	residency_ns[sleeping] +=
+			ktime_to_ns(ktime_sub(ktime_get(), shid->idle_since));
+	mutex_unlock(&shid->power_lock);
+
+	return snprintf(buf, PAGE_SIZE,
+			"idle_ms %u state %s sleeps %u wakes %u residency_ms active %llu sleep %llu power_support %u response_delay_ms %u\n",
+			shid->idle_sleep_ms, sleeping ? "sleep" : "active",
+			shid->idle_sleeps, shid->idle_wakes,
+			div_u64(residency_ns[0], NSEC_PER_MSEC),
+			div_u64(residency_ns[1], NSEC_PER_MSEC),
+			shid->desc.device_power_support,
+			shid->desc.power_response_delay);
+}
+
+/* Takes the idle period in ms, 0 turns the governor off */
+static ssize_t spi_hid_idle_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t size)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+
+	if (kstrtou32(buf, 10, &shid->idle_sleep_ms))
+		return -EINVAL;
+
+	if (!shid->idle_sleep_ms)
+		cancel_delayed_work_sync(&shid->idle_work);
+	else
+		spi_hid_idle_activity(shid);
+
+	return size;
+}
+static DEVICE_ATTR_RW(spi_hid_idle);
+
+static const struct attribute *const spi_hid_attributes[] = {
+	&dev_attr_ready.attr,
+	&dev_attr_bus_error_count.attr,
+	&dev_attr_regulator_error_count.attr,
+	&dev_attr_device_initiated_reset_count.attr,
+	&dev_attr_logic_error_count.attr,
+	&dev_attr_recovery_count.attr,
+	&dev_attr_reset_timing.attr,
+	&dev_attr_descriptor_cache.attr,
+	&dev_attr_spi_hid_latency.attr,
+	&dev_attr_spi_hid_perf_mode.attr,
+	&dev_attr_spi_hid_lowlat_mode.attr,
+	&dev_attr_spi_hid_lowlat_cpu.attr,
+	&dev_attr_spi_hid_lowlat_idle_ms.attr,
+	&dev_attr_spi_hid_lowlat_speed_hz.attr,
+	&dev_attr_spi_hid_clk_scaling.attr,
+	&dev_attr_spi_hid_watchdog.attr,
+	&dev_attr_spi_hid_clk_calibrate.attr,
+	&dev_attr_off_delay_ms.attr,
+	&dev_attr_open_grace_ms.attr,
+	&dev_attr_spi_hid_wq_cpus.attr,
+	&dev_attr_spi_hid_trace_sample.attr,
+	&dev_attr_spi_hid_idle.attr,
+	NULL	/* Terminator */
+};
+
+/* 6e2ac436-0fcf-41af-a265-b32a220dcfab */
+static const guid_t SPI_HID_DSM_GUID =
+	GUID_INIT(0x6e2ac436, 0x0fcf, 0x41af,
+		  0xa2, 0x65, 0xb3, 0x2a, 0x22, 0x0d, 0xcf, 0xab);
+
+#define SPI_HID_DSM_REVISION	1
+
+enum spi_hid_dsm_fn {
+	SPI_HID_DSM_FN_REG_ADDR = 1,
+};
+
+static int spi_hid_get_descriptor_reg_acpi(struct device *dev, u32 *reg)
+{
+	acpi_handle handle = ACPI_HANDLE(dev);
+	union acpi_object *obj;
+	u64 val;
+
+	obj = acpi_evaluate_dsm_typed(handle, &SPI_HID_DSM_GUID, SPI_HID_DSM_REVISION,
+				      SPI_HID_DSM_FN_REG_ADDR, NULL, ACPI_TYPE_INTEGER);
+	if (!obj)
+		return -EIO;
+
+	val = obj->integer.value;
+	ACPI_FREE(obj);
+
+	if (val > U32_MAX)
+		return -ERANGE;
+
+	*reg = val;
+	return 0;
+}
+
+static int spi_hid_get_descriptor_reg(struct device *dev, u32 *reg)
+{
+	if (dev->of_node || !has_acpi_companion(dev))
+		return device_property_read_u32(dev, "hid-descr-addr", reg);
+	else
+		return spi_hid_get_descriptor_reg_acpi(dev, reg);
+}
+
+/*
+* Idle devices are sent to SLEEP, where they keep the IRQ armed and can
+* wake on touch. Devices that cannot sleep are powered off right away.
+*/
+static int spi_hid_runtime_suspend(struct device *dev)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+	u8 prev_state;
+	int ret;
+
+	spi_hid_idle_stop(shid);
+	cancel_delayed_work_sync(&shid->wd_work);
+	cancel_work_sync(&shid->wd_alarm_work);
+
+	prev_state = shid->power_state;
+	if (prev_state == SPI_HID_POWER_MODE_SLEEP) {
+		/* Already put to sleep by the idle governor */
+		queue_delayed_work(shid->wq, &shid->off_work,
+				msecs_to_jiffies(shid->off_delay_ms));
+		return 0;
+	}
+
+	if (prev_state != SPI_HID_POWER_MODE_ACTIVE)
+		return 0;
+
+	if (!shid->ready ||
+		shid->desc.device_power_support == SPI_HID_POWER_SUPPORT_NONE)
+		goto off;
+
+	ret = spi_hid_set_power(shid, SPI_HID_POWER_MODE_SLEEP);
+	if (ret) {
+		dev_err(dev, "%s: failed to enter sleep: %d\n", __func__, ret);
+		goto off;
+	}
+
+	shid->power_state = SPI_HID_POWER_MODE_SLEEP;
+	queue_delayed_work(shid->wq, &shid->off_work,
+			msecs_to_jiffies(shid->off_delay_ms));
+	dev_err(dev, "%s: %s -> %s\n", __func__,
+			spi_hid_power_mode_string(prev_state),
+			spi_hid_power_mode_string(shid->power_state));
+
+	return 0;
+
+off:
+	spi_hid_power_off(shid);
+
+	return 0;
+}
+
+static int spi_hid_runtime_resume(struct device *dev)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+	u8 prev_state;
+	int ret;
+
+	cancel_delayed_work_sync(&shid->off_work);
+
+	prev_state = shid->power_state;
+	if (prev_state == SPI_HID_POWER_MODE_SLEEP) {
+		ret = spi_hid_set_power(shid, SPI_HID_POWER_MODE_ACTIVE);
+		if (!ret) {
+			shid->power_state = SPI_HID_POWER_MODE_ACTIVE;
+			dev_err(dev, "%s: %s -> %s\n", __func__,
+					spi_hid_power_mode_string(prev_state),
+					spi_hid_power_mode_string(shid->power_state));
+			return 0;
+		}
+
+		dev_err(dev, "%s: failed to wake: %d\n", __func__, ret);
+		spi_hid_power_off(shid);
+	}
+
+	return spi_hid_power_on(shid);
+}
+
+/*
+* System sleep keeps the HID device and the parsed descriptors. The device
+* is put in WAKING_SLEEP, or powered off if it has no power support or does
+* not take the command.
+*/
+static int spi_hid_suspend(struct device *dev)
+{
+	struct spi_hid *shid = dev_get_drvdata(dev);
+	u8 prev_state;
+	int ret;
+
+	spi_hid_idle_stop(shid);
+	cancel_delayed_work_sync(&shid->off_work);
+	cancel_delayed_work_sync(&shid->wd_work);
+	cancel_work_sync(&shid->wd_alarm_work);
+	prev_state = shid->power_state;
+
+	if (prev_state == SPI_HID_POWER_MODE_OFF)
+		return 0;
+
+	if (!shid->ready ||
+		shid->desc.device_power_support == SPI_HID_POWER_SUPPORT_NONE) {
+		spi_hid_power_off(shid);
+		return 0;
+	}
+
+	ret = spi_hid_set_power(shid, SPI_HID_POWER_MODE_WAKING_SLEEP);
+	if (ret) {
+		dev_err(dev, "%s: failed to enter waking sleep: %d\n",
+				__func__, ret);
+		spi_hid_power_off(shid);
+		return 0;
+	}
+
+	if (shid->irq_enabled) {
+		disable_irq(shid->irq);
+		shid->irq_enabled = false;
+	}
+	if (device_may_wakeup(dev))
+		enable_irq_wake(shid->irq);
+
+	shid->power_state = SPI_HID_POWER_MODE_WAKING_SLEEP;
+	dev_err(dev, "%s: %s -> %s\n", __func__,
+			spi_hid_power_mode_string(prev_state),
+			spi_hid_power_mode_string(shid->power_state));
 
-	return snprintf(buf, PAGE_SIZE, "%d (%d)\n",
-			shid->logic_error_count, shid->logic_last_error);
+	return 0;
 }
-static DEVICE_ATTR_RO(logic_error_count);
 
-static ssize_t
-spi_hid_latency_show(struct device *dev, struct device_attribute *attr, char *buf)
+/*
+* Resumes without recreating the HID device. A single device descriptor
+* request confirms the device is still the one we know, the refresh worker
+* then makes it ready from the descriptor cache. A device that suspend
+* powered off goes through a full power on if it is still in use.
+*/
+static int spi_hid_resume(struct device *dev)
 {
 	struct spi_hid *shid = dev_get_drvdata(dev);
-	int count = 0;
-	int i = 0;
+	u8 prev_state = shid->power_state;
+	u8 next_state = SPI_HID_POWER_MODE_ACTIVE;
+	int ret;
 
-	for (i = 0; i < SPI_HID_MAX_LATENCIES; i++) {
-		if (shid->latencies[i].report_id == 0)
-			break;
+	if (prev_state == SPI_HID_POWER_MODE_OFF) {
+		if (pm_runtime_status_suspended(dev))
+			return 0;
 
-		count += snprintf(buf + count, PAGE_SIZE, "%u %u %llu %llu|",
-					shid->latencies[i].report_id,
-					shid->latencies[i].signature,
-					shid->latencies[i].start_time,
-					shid->latencies[i].end_time);
+		return spi_hid_power_on(shid);
 	}
 
-	return count;
-}
-static DEVICE_ATTR_RO(spi_hid_latency);
+	if (prev_state != SPI_HID_POWER_MODE_WAKING_SLEEP)
+		return 0;
 
-static ssize_t
-spi_hid_perf_mode_show(struct device *dev, struct device_attribute *attr, char *buf)
-{
-	struct spi_hid *shid = dev_get_drvdata(dev);
-	int count = 0;
+	if (device_may_wakeup(dev))
+		disable_irq_wake(shid->irq);
+	if (!shid->irq_enabled) {
+		enable_irq(shid->irq);
+		shid->irq_enabled = true;
+	}
 
-	count += snprintf(buf, PAGE_SIZE, "%d", shid->perf_mode);
+	/* Nobody has the device open, let it go straight back to sleep */
+	if (pm_runtime_status_suspended(dev))
+		next_state = SPI_HID_POWER_MODE_SLEEP;
 
-	return count;
-}
+	ret = spi_hid_set_power(shid, next_state);
+	if (ret) {
+		dev_err(dev, "%s: failed to wake: %d\n", __func__, ret);
+		goto err;
+	}
 
-static ssize_t
-spi_hid_perf_mode_store(struct device *dev,
-			struct device_attribute *attr,
-			const char *buf,
-			size_t size)
-{
-	struct spi_hid *shid = dev_get_drvdata(dev);
-	unsigned long flags;
+	shid->power_state = next_state;
+	dev_err(dev, "%s: %s -> %s\n", __func__,
+			spi_hid_power_mode_string(prev_state),
+			spi_hid_power_mode_string(shid->power_state));
 
-	spin_lock_irqsave(&shid->input_lock, flags);
-	if (kstrtou8(buf, 10, &shid->perf_mode))
-		return -EINVAL;
+	if (next_state == SPI_HID_POWER_MODE_SLEEP) {
+		queue_delayed_work(shid->wq, &shid->off_work,
+				msecs_to_jiffies(shid->off_delay_ms));
+		return 0;
+	}
 
-	// Reset the log
-	if (shid->perf_mode) {
-		memset(shid->latencies, 0, sizeof(shid->latencies));
-		shid->latency_index = 0;
+	shid->ready = false;
+	ret = spi_hid_device_descriptor_request(shid);
+	if (ret) {
+		dev_err(dev, "%s: failed to verify device: %d\n", __func__, ret);
+		goto err;
 	}
 
-	spin_unlock_irqrestore(&shid->input_lock, flags);
+	return 0;
 
-	return size;
-}
+err:
+	shid->power_state = SPI_HID_POWER_MODE_ACTIVE;
+	spi_hid_schedule_recovery(shid, SPI_HID_RECOVERY_HARD_RESET);
 
-static DEVICE_ATTR_RW(spi_hid_perf_mode);
+	return 0;
+}
 
-static const struct attribute *const spi_hid_attributes[] = {
-	&dev_attr_ready.attr,
-	&dev_attr_bus_error_count.attr,
-	&dev_attr_regulator_error_count.attr,
-	&dev_attr_device_initiated_reset_count.attr,
-	&dev_attr_logic_error_count.attr,
-	&dev_attr_spi_hid_latency.attr,
-	&dev_attr_spi_hid_perf_mode.attr,
-	NULL	/* Terminator */
-};
+/*
+* Brings the device out of reset after probe. Readiness is reported through
+* the ready attribute once the device descriptor has been handled.
+*/
+static void spi_hid_bringup_work(struct work_struct *work)
+{
+	struct spi_hid *shid =
+		container_of(work, struct spi_hid, bringup_work);
+	struct device *dev = &shid->spi->dev;
+	int ret;
 
-/* 6e2ac436-0fcf-41af-a265-b32a220dcfab */
-static const guid_t SPI_HID_DSM_GUID =
-	GUID_INIT(0x6e2ac436, 0x0fcf, 0x41af,
-		  0xa2, 0x65, 0xb3, 0x2a, 0x22, 0x0d, 0xcf, 0xab);
+	spi_hid_timeline_mark(shid, SPI_HID_TL_BRINGUP);
 
-#define SPI_HID_DSM_REVISION	1
+	if (dev->of_node) {
+		ret = pinctrl_select_state(shid->pinctrl, shid->pinctrl_sleep);
+		if (ret) {
+			dev_err(dev, "Could not select sleep state\n");
+			goto err;
+		}
 
-enum spi_hid_dsm_fn {
-	SPI_HID_DSM_FN_REG_ADDR = 1,
-};
+		msleep(100);
+	}
 
-static int spi_hid_get_descriptor_reg_acpi(struct device *dev, u32 *reg)
-{
-	acpi_handle handle = ACPI_HANDLE(dev);
-	union acpi_object *obj;
-	u64 val;
+	ret = spi_hid_assert_reset(shid);
+	if (ret) {
+		dev_err(dev, "%s: failed to assert reset\n", __func__);
+		goto err;
+	}
 
-	obj = acpi_evaluate_dsm_typed(handle, &SPI_HID_DSM_GUID, SPI_HID_DSM_REVISION,
-				      SPI_HID_DSM_FN_REG_ADDR, NULL, ACPI_TYPE_INTEGER);
-	if (!obj)
-		return -EIO;
+	ret = spi_hid_power_up(shid);
+	if (ret) {
+		dev_err(dev, "%s: could not power up\n", __func__);
+		goto err;
+	}
 
-	val = obj->integer.value;
-	ACPI_FREE(obj);
+	ret = spi_hid_deassert_reset(shid);
+	if (ret) {
+		dev_err(dev, "%s: failed to deassert reset\n", __func__);
+		goto err;
+	}
+	spi_hid_timeline_mark(shid, SPI_HID_TL_RESET_DEASSERT);
 
-	if (val > U32_MAX)
-		return -ERANGE;
+	dev_err(dev, "%s: d3 -> %s\n", __func__,
+			spi_hid_power_mode_string(shid->power_state));
 
-	*reg = val;
-	return 0;
-}
+	return;
 
-static int spi_hid_get_descriptor_reg(struct device *dev, u32 *reg)
-{
-	if (dev->of_node)
-		return device_property_read_u32(dev, "hid-descr-addr", reg);
-	else
-		return spi_hid_get_descriptor_reg_acpi(dev, reg);
+err:
+	spi_hid_stat_inc(shid, SPI_HID_STAT_LOGIC_ERRORS);
+	shid->logic_last_error = ret;
+	sysfs_notify(&dev->kobj, NULL, "ready");
 }
 
 static int spi_hid_probe(struct spi_device *spi)
@@ -2315,9 +5133,27 @@ static int spi_hid_probe(struct spi_device *spi)
 		goto err0;
 	}
 
+	shid->lat_hist = devm_alloc_percpu(dev, struct spi_hid_lat_hist);
+	if (!shid->lat_hist) {
+		ret = -ENOMEM;
+		goto err0;
+	}
+	spin_lock_init(&shid->lat_log_lock);
+	spin_lock_init(&shid->capture_lock);
+	mutex_init(&shid->capture_mutex);
+
+	shid->stats = devm_alloc_percpu(dev, struct spi_hid_stats);
+	if (!shid->stats) {
+		ret = -ENOMEM;
+		goto err0;
+	}
+	shid->stats_rate_ns = ktime_get_ns();
+	shid->trace_sample = 1;
+
 	shid->spi = spi;
 	shid->power_state = SPI_HID_POWER_MODE_ACTIVE;
 	spi_set_drvdata(spi, shid);
+	spi_hid_timeline_mark(shid, SPI_HID_TL_PROBE);
 
 	/* Initialize MSHW0231 specific fields */
 	if (spi_hid_is_mshw0231(shid)) {
@@ -2351,17 +5187,25 @@ static int spi_hid_probe(struct spi_device *spi)
 		dev_info(dev, "MSHW0231: SPI configured - 4MHz, Mode 0, 8-bit\n");
 	}
 
-	ret = sysfs_create_files(&dev->kobj, spi_hid_attributes);
-	if (ret) {
-		dev_err(dev, "Unable to create sysfs attributes\n");
-		goto err0;
+	if (!alloc_cpumask_var(&shid->wq_cpus, GFP_KERNEL) ||
+			!alloc_cpumask_var(&shid->lowlat_affinity, GFP_KERNEL)) {
+		ret = -ENOMEM;
+		goto err1;
+	}
+	cpumask_copy(shid->wq_cpus, cpu_possible_mask);
+
+	shid->wq = alloc_workqueue("spi_hid-%s", WQ_UNBOUND | WQ_HIGHPRI, 0,
+			dev_name(dev));
+	if (!shid->wq) {
+		ret = -ENOMEM;
+		goto err1;
 	}
 
 	ret = spi_hid_get_descriptor_reg(dev, &shid->device_descriptor_register);
 	if (ret) {
 		dev_err(dev, "failed to get HID descriptor register address\n");
 		ret = -ENODEV;
-		goto err1;
+		goto err2;
 	}
 
 	/*
@@ -2373,6 +5217,12 @@ static int spi_hid_probe(struct spi_device *spi)
 	mutex_init(&shid->lock);
 	mutex_init(&shid->power_lock);
 	init_completion(&shid->output_done);
+	init_completion(&shid->response_done);
+	init_completion(&shid->reset_response);
+
+	INIT_LIST_HEAD(&shid->request_queue);
+	spin_lock_init(&shid->request_lock);
+	INIT_WORK(&shid->request_work, spi_hid_request_work);
 
 	if (dev->of_node) {
 		shid->supply = devm_regulator_get(dev, "vdd");
@@ -2381,7 +5231,7 @@ static int spi_hid_probe(struct spi_device *spi)
 				dev_err(dev, "Failed to get regulator: %ld\n",
 						PTR_ERR(shid->supply));
 			ret = PTR_ERR(shid->supply);
-			goto err1;
+			goto err2;
 		}
 
 		shid->pinctrl = devm_pinctrl_get(dev);
@@ -2389,7 +5239,7 @@ static int spi_hid_probe(struct spi_device *spi)
 			dev_err(dev, "Could not get pinctrl handle: %ld\n",
 					PTR_ERR(shid->pinctrl));
 			ret = PTR_ERR(shid->pinctrl);
-			goto err1;
+			goto err2;
 		}
 
 		shid->pinctrl_reset = pinctrl_lookup_state(shid->pinctrl, "reset");
@@ -2397,7 +5247,7 @@ static int spi_hid_probe(struct spi_device *spi)
 			dev_err(dev, "Could not get pinctrl reset: %ld\n",
 					PTR_ERR(shid->pinctrl_reset));
 			ret = PTR_ERR(shid->pinctrl_reset);
-			goto err1;
+			goto err2;
 		}
 
 		shid->pinctrl_active = pinctrl_lookup_state(shid->pinctrl, "active");
@@ -2405,7 +5255,7 @@ static int spi_hid_probe(struct spi_device *spi)
 			dev_err(dev, "Could not get pinctrl active: %ld\n",
 					PTR_ERR(shid->pinctrl_active));
 			 ret = PTR_ERR(shid->pinctrl_active);
-			 goto err1;
+			 goto err2;
 		}
 
 		shid->pinctrl_sleep = pinctrl_lookup_state(shid->pinctrl, "sleep");
@@ -2413,25 +5263,48 @@ static int spi_hid_probe(struct spi_device *spi)
 			dev_err(dev, "Could not get pinctrl sleep: %ld\n",
 					PTR_ERR(shid->pinctrl_sleep));
 			ret = PTR_ERR(shid->pinctrl_sleep);
-			goto err1;
-		}
-
-		ret = pinctrl_select_state(shid->pinctrl, shid->pinctrl_sleep);
-		if (ret) {
-			dev_err(dev, "Could not select sleep state\n");
-			goto err1;
+			goto err2;
 		}
 
-		msleep(100);
 	}
 
 	shid->hid_desc_addr = shid->device_descriptor_register;
 
 	spin_lock_init(&shid->input_lock);
+	INIT_WORK(&shid->bringup_work, spi_hid_bringup_work);
+	INIT_DELAYED_WORK(&shid->off_work, spi_hid_off_work);
+	shid->off_delay_ms = SPI_HID_OFF_DELAY_MS;
+	INIT_DELAYED_WORK(&shid->grace_work, spi_hid_grace_work);
+	INIT_DELAYED_WORK(&shid->wd_work, spi_hid_wd_work);
+	INIT_WORK(&shid->wd_alarm_work, spi_hid_wd_alarm_work);
+	shid->wd_timeout_ms = SPI_HID_WD_TIMEOUT_MS;
+	shid->wd_slo_frames = SPI_HID_WD_SLO_FRAMES;
+	shid->open_grace_ms = SPI_HID_OPEN_GRACE_MS;
+	INIT_DELAYED_WORK(&shid->idle_work, spi_hid_idle_work);
+	INIT_WORK(&shid->idle_wake_work, spi_hid_idle_wake_work);
+	shid->idle_since = ktime_get();
+
+	mutex_init(&shid->lowlat_lock);
+	INIT_WORK(&shid->lowlat_engage_work, spi_hid_lowlat_engage_work);
+	INIT_DELAYED_WORK(&shid->lowlat_idle_work, spi_hid_lowlat_idle_work);
+	shid->lowlat_cpu = -1;
+	shid->lowlat_idle_ms = SPI_HID_LOWLAT_IDLE_MS;
+
+	spin_lock_init(&shid->clk_lock);
+	INIT_DELAYED_WORK(&shid->clk_idle_work, spi_hid_clk_idle_work);
+	shid->clk_state = SPI_HID_CLK_IDLE;
+	shid->clk_up_reports = SPI_HID_CLK_UP_REPORTS;
+	shid->clk_idle_ms = SPI_HID_CLK_IDLE_MS;
+	shid->clk_since = ktime_get();
+	INIT_WORK(&shid->clk_cal_work, spi_hid_clk_cal_work);
+	shid->clk_cal_reads = SPI_HID_CLK_CAL_READS;
 	INIT_WORK(&shid->reset_work, spi_hid_reset_work);
 	INIT_WORK(&shid->create_device_work, spi_hid_create_device_work);
 	INIT_WORK(&shid->refresh_device_work, spi_hid_refresh_device_work);
+	INIT_WORK(&shid->desc_validate_work, spi_hid_desc_validate_work);
+	mutex_init(&shid->desc_cache.lock);
 	INIT_WORK(&shid->error_work, spi_hid_error_work);
+	spin_lock_init(&shid->recovery_lock);
 
 	if (dev->of_node) {
 		shid->irq = spi->irq;
@@ -2439,7 +5312,7 @@ static int spi_hid_probe(struct spi_device *spi)
 		gpiod = gpiod_get_index(&spi->dev, NULL, 0, GPIOD_ASIS);
 		if (IS_ERR(gpiod)) {
 			ret = PTR_ERR(gpiod);
-			goto err1;
+			goto err2;
 		}
 
 		shid->irq = gpiod_to_irq(gpiod);
@@ -2449,35 +5322,65 @@ static int spi_hid_probe(struct spi_device *spi)
 	irqflags = irq_get_trigger_type(shid->irq) | IRQF_ONESHOT;
 	ret = request_irq(shid->irq, spi_hid_dev_irq, irqflags, dev_name(&spi->dev), shid);
 	if (ret)
-		goto err1;
+		goto err2;
 
 	shid->irq_enabled = true;
 
-	ret = spi_hid_assert_reset(shid);
+	/* Only now that all state is set up, expose it to userspace */
+	ret = sysfs_create_files(&dev->kobj, spi_hid_attributes);
 	if (ret) {
-		dev_err(dev, "%s: failed to assert reset\n", __func__);
-		goto err1;
+		dev_err(dev, "Unable to create sysfs attributes\n");
+		goto err3;
 	}
 
-	ret = spi_hid_power_up(shid);
-	if (ret) {
-		dev_err(dev, "%s: could not power up\n", __func__);
-		goto err1;
-	}
+	shid->debugfs = debugfs_create_dir(dev_name(dev), spi_hid_debugfs_root);
+	debugfs_create_file("timeline", 0444, shid->debugfs, shid,
+			&spi_hid_timeline_fops);
+	debugfs_create_file("stats", 0444, shid->debugfs, shid,
+			&spi_hid_stats_fops);
+	debugfs_create_file("latency_hist", 0444, shid->debugfs, shid,
+			&spi_hid_latency_hist_fops);
+	debugfs_create_file("latency_log", 0444, shid->debugfs, shid,
+			&spi_hid_lat_log_fops);
+	debugfs_create_file("latency_log_bin", 0444, shid->debugfs, shid,
+			&spi_hid_lat_log_bin_fops);
+	debugfs_create_file_unsafe("latency_log_depth", 0644, shid->debugfs,
+			shid, &spi_hid_lat_log_depth_fops);
+	debugfs_create_bool("latency_log_consume", 0644, shid->debugfs,
+			&shid->lat_log_consume);
+	debugfs_create_u64("latency_log_dropped", 0444, shid->debugfs,
+			&shid->lat_log_dropped);
+	debugfs_create_file_unsafe("capture_enable", 0644, shid->debugfs,
+			shid, &spi_hid_capture_enable_fops);
+	debugfs_create_u64("capture_dropped", 0444, shid->debugfs,
+			&shid->capture_dropped);
+	debugfs_create_file("replay", 0200, shid->debugfs, shid,
+			&spi_hid_replay_fops);
+	debugfs_create_u64("replay_count", 0444, shid->debugfs,
+			&shid->replay_count);
+
+	/* The bring-up reference is dropped once the HID device exists */
+	shid->pm_bringup_ref = true;
+	pm_runtime_get_noresume(dev);
+	pm_runtime_set_active(dev);
+	pm_runtime_set_autosuspend_delay(dev, SPI_HID_AUTOSUSPEND_DELAY_MS);
+	pm_runtime_use_autosuspend(dev);
+	pm_runtime_enable(dev);
+
+	/* Power-up and reset can take over a second, keep them off the probe path */
+	spi_hid_queue_work(shid, &shid->bringup_work);
 
-	ret = spi_hid_deassert_reset(shid);
-	if (ret) {
-		dev_err(dev, "%s: failed to deassert reset\n", __func__);
-		goto err1;
-	}
+	return 0;
 
-	dev_err(dev, "%s: d3 -> %s\n", __func__,
-			spi_hid_power_mode_string(shid->power_state));
+err3:
+	free_irq(shid->irq, shid);
 
-	return 0;
+err2:
+	destroy_workqueue(shid->wq);
 
 err1:
-	sysfs_remove_files(&dev->kobj, spi_hid_attributes);
+	free_cpumask_var(shid->lowlat_affinity);
+	free_cpumask_var(shid->wq_cpus);
 
 err0:
 	return ret;
@@ -2487,14 +5390,58 @@ static void spi_hid_remove(struct spi_device *spi)
 {
 	struct spi_hid *shid = spi_get_drvdata(spi);
 	struct device *dev = &spi->dev;
+	unsigned long flags;
 
 	dev_info(dev, "%s\n", __func__);
 
+	/*
+	* Drop capture_enable first so the capture can't be restarted. Writers
+	* hold capture_lock for the whole reserve and copy and re-check
+	* capture_on under it, so once the flag is cleared under the lock no
+	* writer can still be touching the channel.
+	*/
+	debugfs_lookup_and_remove("capture_enable", shid->debugfs);
+	spin_lock_irqsave(&shid->capture_lock, flags);
+	shid->capture_on = false;
+	spin_unlock_irqrestore(&shid->capture_lock, flags);
+	if (shid->capture)
+		relay_close(shid->capture);
+	debugfs_remove_recursive(shid->debugfs);
+	cancel_work_sync(&shid->bringup_work);
+	cancel_delayed_work_sync(&shid->grace_work);
+	pm_runtime_disable(dev);
+	pm_runtime_dont_use_autosuspend(dev);
+	if (shid->pm_bringup_ref)
+		pm_runtime_put_noidle(dev);
+	cancel_delayed_work_sync(&shid->off_work);
+	shid->wd_timeout_ms = 0;
+	cancel_delayed_work_sync(&shid->wd_work);
+	shid->idle_sleep_ms = 0;
+	spi_hid_idle_stop(shid);
+	shid->lowlat_mode = false;
+	spi_hid_lowlat_stop(shid);
+	cancel_work_sync(&shid->clk_cal_work);
+	cancel_delayed_work_sync(&shid->clk_idle_work);
 	spi_hid_power_down(shid);
 	free_irq(shid->irq, shid);
 	shid->irq_enabled = false;
+	cancel_work_sync(&shid->wd_alarm_work);
 	sysfs_remove_files(&dev->kobj, spi_hid_attributes);
 	spi_hid_stop_hid(shid);
+	spi_hid_request_queue_stop(shid);
+	/*
+	* Shut the timer down first so a running stage can't re-arm it, then
+	* wait for the stage work the timer may already have queued
+	*/
+	if (spi_hid_is_mshw0231(shid)) {
+		timer_shutdown_sync(&shid->staging_timer);
+		cancel_work_sync(&shid->staged_init_work);
+	}
+	destroy_workqueue(shid->wq);
+	free_cpumask_var(shid->lowlat_affinity);
+	free_cpumask_var(shid->wq_cpus);
+	kvfree(shid->lat_log);
+	kfree(shid->desc_cache.report_desc);
 }
 
 /* Windows-style power management functions for MSHW0231 */
@@ -2515,12 +5462,11 @@ static int spi_hid_send_power_transition(struct spi_hid *shid, u8 power_state)
 
 	report.content_type = SPI_HID_CONTENT_TYPE_SET_FEATURE;
 	report.content_id = 0x06; /* Power management report ID */
-	report.content_length = 4;
+	report.content_length = sizeof(power_cmd) + 3;
 	report.content = power_cmd;
 
-	mutex_lock(&shid->lock);
-	ret = spi_hid_send_output_report(shid, shid->desc.output_register, &report);
-	mutex_unlock(&shid->lock);
+	ret = spi_hid_sync_request(shid, shid->desc.output_register, &report,
+			NULL, 0);
 	
 	if (ret)
 		dev_err(dev, "Failed to send power transition command: %d\n", ret);
@@ -2555,18 +5501,14 @@ static int spi_hid_send_reset_notification(struct spi_hid *shid)
 
 	report.content_type = SPI_HID_CONTENT_TYPE_SET_FEATURE;
 	report.content_id = 0x01; /* Reset notification report ID */
-	report.content_length = 2;
+	report.content_length = sizeof(reset_cmd) + 3;
 	report.content = reset_cmd;
 
-	mutex_lock(&shid->lock);
-	ret = spi_hid_send_output_report(shid, shid->desc.output_register, &report);
-	mutex_unlock(&shid->lock);
-	
+	/* Windows waits 100ms after reset notifications */
+	ret = spi_hid_async_request(shid, shid->desc.output_register, &report,
+			100);
 	if (ret)
 		dev_err(dev, "Failed to send reset notification: %d\n", ret);
-
-	/* Windows waits 100ms after reset notifications */
-	msleep(100);
 	
 	return ret;
 }
@@ -2595,17 +5537,13 @@ static int spi_hid_send_enhanced_power_mgmt(struct spi_hid *shid, u8 enable)
 
 	report.content_type = SPI_HID_CONTENT_TYPE_SET_FEATURE;
 	report.content_id = 0x05; /* Enhanced power management report ID */
-	report.content_length = 3;
+	report.content_length = sizeof(power_mgmt_cmd) + 3;
 	report.content = power_mgmt_cmd;
 
-	mutex_lock(&shid->lock);
-	ret = spi_hid_send_output_report(shid, shid->desc.output_register, &report);
-	mutex_unlock(&shid->lock);
-	
+	ret = spi_hid_async_request(shid, shid->desc.output_register, &report,
+			30);
 	if (ret)
 		dev_err(dev, "Failed to send enhanced power management command: %d\n", ret);
-
-	msleep(30);
 	
 	return ret;
 }
@@ -2626,17 +5564,13 @@ static int spi_hid_send_selective_suspend(struct spi_hid *shid, u8 enable)
 
 	report.content_type = SPI_HID_CONTENT_TYPE_SET_FEATURE;
 	report.content_id = 0x04; /* Selective suspend report ID */
-	report.content_length = 3;
+	report.content_length = sizeof(suspend_cmd) + 3;
 	report.content = suspend_cmd;
 
-	mutex_lock(&shid->lock);
-	ret = spi_hid_send_output_report(shid, shid->desc.output_register, &report);
-	mutex_unlock(&shid->lock);
-	
+	ret = spi_hid_async_request(shid, shid->desc.output_register, &report,
+			30);
 	if (ret)
 		dev_err(dev, "Failed to send selective suspend command: %d\n", ret);
-
-	msleep(30);
 	
 	return ret;
 }
@@ -2828,10 +5762,11 @@ static int spi_hid_send_multitouch_enable_collection_06(struct spi_hid *shid)
 	/* Send standard HID multi-touch enable targeted at Collection 06 */
 	report.content_type = SPI_HID_CONTENT_TYPE_SET_FEATURE;
 	report.content_id = 0x06; /* Target Collection 06 specifically */
-	report.content_length = 3;
+	report.content_length = sizeof(multitouch_cmd) + 3;
 	report.content = multitouch_cmd;
 	
-	ret = spi_hid_send_output_report(shid, shid->desc.output_register, &report);
+	ret = spi_hid_async_request(shid, shid->desc.output_register, &report,
+			0);
 	if (ret) {
 		dev_warn(dev, "MSHW0231: Collection 06 multi-touch enable failed: %d\n", ret);
 	} else {
@@ -2897,12 +5832,20 @@ static const struct spi_device_id spi_hid_id_table[] = {
 };
 MODULE_DEVICE_TABLE(spi, spi_hid_id_table);
 
+static const struct dev_pm_ops spi_hid_pm_ops = {
+	SET_SYSTEM_SLEEP_PM_OPS(spi_hid_suspend, spi_hid_resume)
+	SET_RUNTIME_PM_OPS(spi_hid_runtime_suspend, spi_hid_runtime_resume,
+			NULL)
+};
+
 static struct spi_driver spi_hid_driver = {
 	.driver = {
 		.name	= "spi_hid",
 		.owner	= THIS_MODULE,
 		.of_match_table = of_match_ptr(spi_hid_of_match),
 		.acpi_match_table = ACPI_PTR(spi_hid_acpi_match),
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
+		.pm = &spi_hid_pm_ops,
 	},
 	.probe		= spi_hid_probe,
 	.remove		= spi_hid_remove,
@@ -2927,17 +5870,14 @@ static int spi_hid_minimal_descriptor_request(struct spi_hid *shid)
 	/* Prepare minimal HID output report */
 	report.content_type = SPI_HID_CONTENT_TYPE_OUTPUT_REPORT;
 	report.content_id = 0x00; /* Report ID 0 - basic output */
-	report.content_length = 2;
+	report.content_length = sizeof(wake_cmd) + 3;
 	report.content = wake_cmd;
 	
-	mutex_lock(&shid->lock);
-	
 	dev_info(dev, "MSHW0231: Sending basic HID output report to wake device...\n");
 	
 	/* Send the simplest possible HID command */
-	ret = spi_hid_send_output_report(shid, shid->desc.output_register, &report);
-	
-	mutex_unlock(&shid->lock);
+	ret = spi_hid_sync_request(shid, shid->desc.output_register, &report,
+			NULL, 0);
 	
 	if (ret < 0) {
 		dev_warn(dev, "MSHW0231: Wake command failed: %d\n", ret);
@@ -3038,21 +5978,82 @@ static int spi_hid_gpio_85_reset(struct spi_hid *shid)
 	return 0;
 }
 
+/*
+* Moves staged initialization on to @next. With a non-zero @wait mask the
+* next stage runs when one of those device events arrives, or when the
+* MSHW0231_STAGE_DELAY_MS ceiling expires, whichever comes first. Events
+* that arrived while the current stage was still running count as well.
+*/
+static void spi_hid_windows_stage_next(struct spi_hid *shid, u8 next,
+		unsigned long wait)
+{
+	shid->initialization_stage = next;
+
+	if (!wait) {
+		shid->staging_event = MSHW0231_STAGE_EVENT_NONE;
+		spi_hid_queue_work(shid, &shid->staged_init_work);
+		return;
+	}
+
+	mod_timer(&shid->staging_timer,
+			jiffies + msecs_to_jiffies(MSHW0231_STAGE_DELAY_MS));
+	WRITE_ONCE(shid->staging_wait, wait);
+	smp_mb();
+
+	if ((READ_ONCE(shid->staging_seen) & wait) &&
+			xchg(&shid->staging_wait, 0)) {
+		shid->staging_event = ffs(shid->staging_seen & wait) - 1;
+		del_timer(&shid->staging_timer);
+		spi_hid_queue_work(shid, &shid->staged_init_work);
+	}
+}
+
+/* Called from IRQ and report handling context */
+static void spi_hid_windows_stage_event(struct spi_hid *shid, int event)
+{
+	if (!shid->interrupt_driven_mode)
+		return;
+
+	set_bit(event, &shid->staging_seen);
+
+	if (!test_bit(event, &shid->staging_wait) ||
+			!xchg(&shid->staging_wait, 0))
+		return;
+
+	shid->staging_event = event;
+	del_timer(&shid->staging_timer);
+	spi_hid_queue_work(shid, &shid->staged_init_work);
+}
+
 /* Windows-style interrupt-driven SPI implementation */
 static void spi_hid_windows_staged_init_work(struct work_struct *work)
 {
 	struct spi_hid *shid = container_of(work, struct spi_hid, staged_init_work);
 	struct device *dev = &shid->spi->dev;
+	ktime_t now = ktime_get();
 	int ret;
 	
 	dev_info(dev, "MSHW0231: Windows-style staged initialization - Stage %d\n", shid->initialization_stage);
+
+	if (shid->initialization_stage <= MSHW0231_STAGE_FULL_OPERATIONAL)
+		spi_hid_timeline_mark(shid,
+				SPI_HID_TL_STAGE_0 + shid->initialization_stage);
+
+	if (shid->initialization_stage == MSHW0231_STAGE_INITIAL)
+		shid->staging_init_start = now;
+	else
+		trace_spi_hid_staged_init_stage(shid, shid->staging_last_stage,
+				shid->staging_event,
+				ktime_us_delta(now, shid->staging_stage_start));
+	shid->staging_last_stage = shid->initialization_stage;
+	shid->staging_stage_start = now;
+	shid->staging_seen = 0;
 	
 	switch (shid->initialization_stage) {
 	case MSHW0231_STAGE_INITIAL:
 		dev_info(dev, "MSHW0231: Stage 0 - Initial device detection (read-only)\n");
 		/* Only read operations in stage 0 - no SPI output commands */
-		shid->initialization_stage = MSHW0231_STAGE_ACPI_SETUP;
-		mod_timer(&shid->staging_timer, jiffies + msecs_to_jiffies(MSHW0231_STAGE_DELAY_MS));
+		spi_hid_windows_stage_next(shid, MSHW0231_STAGE_ACPI_SETUP, 0);
 		break;
 		
 	case MSHW0231_STAGE_ACPI_SETUP:
@@ -3061,8 +6062,8 @@ static void spi_hid_windows_staged_init_work(struct work_struct *work)
 		if (ret) {
 			dev_warn(dev, "MSHW0231: ACPI _DSM failed: %d, continuing\n", ret);
 		}
-		shid->initialization_stage = MSHW0231_STAGE_GPIO_RESET;
-		mod_timer(&shid->staging_timer, jiffies + msecs_to_jiffies(MSHW0231_STAGE_DELAY_MS));
+		/* _DSM is synchronous, nothing to wait for */
+		spi_hid_windows_stage_next(shid, MSHW0231_STAGE_GPIO_RESET, 0);
 		break;
 		
 	case MSHW0231_STAGE_GPIO_RESET:
@@ -3071,8 +6072,10 @@ static void spi_hid_windows_staged_init_work(struct work_struct *work)
 		if (ret) {
 			dev_warn(dev, "MSHW0231: GPIO reset failed: %d, continuing\n", ret);
 		}
-		shid->initialization_stage = MSHW0231_STAGE_SMALL_COMMANDS;
-		mod_timer(&shid->staging_timer, jiffies + msecs_to_jiffies(MSHW0231_STAGE_DELAY_MS));
+		/* The device signals it is out of reset with an IRQ */
+		spi_hid_windows_stage_next(shid, MSHW0231_STAGE_SMALL_COMMANDS,
+				BIT(MSHW0231_STAGE_EVENT_IRQ) |
+				BIT(MSHW0231_STAGE_EVENT_RESET_RESP));
 		break;
 		
 	case MSHW0231_STAGE_SMALL_COMMANDS:
@@ -3080,8 +6083,8 @@ static void spi_hid_windows_staged_init_work(struct work_struct *work)
 		/* Windows evidence: 12-byte commands first */
 		dev_info(dev, "MSHW0231: [Log] Would send 12-byte initialization command\n");
 		ret = spi_hid_windows_staged_command(shid, MSHW0231_STAGE_SMALL_COMMANDS);
-		shid->initialization_stage = MSHW0231_STAGE_MEDIUM_COMMANDS;
-		mod_timer(&shid->staging_timer, jiffies + msecs_to_jiffies(MSHW0231_STAGE_DELAY_MS));
+		spi_hid_windows_stage_next(shid, MSHW0231_STAGE_MEDIUM_COMMANDS,
+				ret > 0 ? BIT(MSHW0231_STAGE_EVENT_RESPONSE) : 0);
 		break;
 		
 	case MSHW0231_STAGE_MEDIUM_COMMANDS:
@@ -3089,8 +6092,8 @@ static void spi_hid_windows_staged_init_work(struct work_struct *work)
 		/* Windows evidence: 50-byte commands next */
 		dev_info(dev, "MSHW0231: [Log] Would send 50-byte configuration command\n");
 		ret = spi_hid_windows_staged_command(shid, MSHW0231_STAGE_MEDIUM_COMMANDS);
-		shid->initialization_stage = MSHW0231_STAGE_LARGE_COMMANDS;
-		mod_timer(&shid->staging_timer, jiffies + msecs_to_jiffies(MSHW0231_STAGE_DELAY_MS));
+		spi_hid_windows_stage_next(shid, MSHW0231_STAGE_LARGE_COMMANDS,
+				ret > 0 ? BIT(MSHW0231_STAGE_EVENT_RESPONSE) : 0);
 		break;
 		
 	case MSHW0231_STAGE_LARGE_COMMANDS:
@@ -3098,13 +6101,14 @@ static void spi_hid_windows_staged_init_work(struct work_struct *work)
 		/* Windows evidence: 132-byte commands final */
 		dev_info(dev, "MSHW0231: [Log] Would send 132-byte activation command\n");
 		ret = spi_hid_windows_staged_command(shid, MSHW0231_STAGE_LARGE_COMMANDS);
-		shid->initialization_stage = MSHW0231_STAGE_FULL_OPERATIONAL;
-		mod_timer(&shid->staging_timer, jiffies + msecs_to_jiffies(MSHW0231_STAGE_DELAY_MS));
+		spi_hid_windows_stage_next(shid, MSHW0231_STAGE_FULL_OPERATIONAL,
+				ret > 0 ? BIT(MSHW0231_STAGE_EVENT_RESPONSE) : 0);
 		break;
 		
 	case MSHW0231_STAGE_FULL_OPERATIONAL:
 		dev_info(dev, "MSHW0231: Stage 6 - Device fully operational (Windows-compatible)\n");
-		dev_info(dev, "MSHW0231: Windows-style staged initialization complete\n");
+		dev_info(dev, "MSHW0231: Windows-style staged initialization complete in %lld us\n",
+				ktime_us_delta(now, shid->staging_init_start));
 		dev_info(dev, "MSHW0231: Device ready for interrupt-driven communication\n");
 		shid->collection_06_parsed = true;
 		break;
@@ -3119,8 +6123,12 @@ static void spi_hid_windows_staging_timer(struct timer_list *timer)
 {
 	struct spi_hid *shid = from_timer(shid, timer, staging_timer);
 	
-	/* Schedule next stage of Windows-compatible initialization */
-	schedule_work(&shid->staged_init_work);
+	/* The awaited event did not arrive, move on to the next stage anyway */
+	if (!xchg(&shid->staging_wait, 0))
+		return;
+
+	shid->staging_event = MSHW0231_STAGE_EVENT_TIMEOUT;
+	spi_hid_queue_work(shid, &shid->staged_init_work);
 }
 
 static int spi_hid_windows_interrupt_setup(struct spi_hid *shid)
@@ -3130,11 +6138,12 @@ static int spi_hid_windows_interrupt_setup(struct spi_hid *shid)
 	dev_info(dev, "MSHW0231: Setting up Windows-compatible interrupt-driven SPI\n");
 	
 	/* Start staged initialization process */
-	schedule_work(&shid->staged_init_work);
+	spi_hid_queue_work(shid, &shid->staged_init_work);
 	
 	return 0;
 }
 
+/* Returns the number of bytes sent to the device for @stage */
 static int spi_hid_windows_staged_command(struct spi_hid *shid, u8 stage)
 {
 	struct device *dev = &shid->spi->dev;
@@ -3155,11 +6164,30 @@ static int spi_hid_windows_staged_command(struct spi_hid *shid, u8 stage)
 		break;
 	}
 	
-	/* Return success for logging-only mode */
+	/* Nothing is sent in logging-only mode, so there is no response to wait for */
 	return 0;
 }
 
-module_spi_driver(spi_hid_driver);
+static int __init spi_hid_init(void)
+{
+	int ret;
+
+	spi_hid_debugfs_root = debugfs_create_dir("spi_hid", NULL);
+
+	ret = spi_register_driver(&spi_hid_driver);
+	if (ret)
+		debugfs_remove_recursive(spi_hid_debugfs_root);
+
+	return ret;
+}
+module_init(spi_hid_init);
+
+static void __exit spi_hid_exit(void)
+{
+	spi_unregister_driver(&spi_hid_driver);
+	debugfs_remove_recursive(spi_hid_debugfs_root);
+}
+module_exit(spi_hid_exit);
 
 MODULE_DESCRIPTION("HID over SPI transport driver");
 MODULE_LICENSE("GPL");
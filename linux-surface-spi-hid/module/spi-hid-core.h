@@ -30,11 +30,21 @@
 #define MSHW0231_STAGE_LARGE_COMMANDS		0x05	/* 132-byte commands */
 #define MSHW0231_STAGE_FULL_OPERATIONAL		0x06	/* Device ready */
 
+/* Device events that complete a staged initialization wait (bit numbers) */
+#define MSHW0231_STAGE_EVENT_IRQ		0	/* Device interrupt */
+#define MSHW0231_STAGE_EVENT_RESET_RESP		1	/* Reset response report */
+#define MSHW0231_STAGE_EVENT_RESPONSE		2	/* Handshake or command response */
+#define MSHW0231_STAGE_EVENT_NONE		30	/* Stage did not wait */
+#define MSHW0231_STAGE_EVENT_TIMEOUT		31	/* Stage delay ceiling hit */
+
 /* Windows timing constants from trace analysis */
 #define MSHW0231_WINDOWS_IRQ			1033	/* IRQ from Windows traces */
-#define MSHW0231_STAGE_DELAY_MS			255	/* 255ms delays from Windows */
+#define MSHW0231_STAGE_DELAY_MS			255	/* 255ms ceiling, from Windows */
 #include <linux/completion.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
 #include <linux/pinctrl/consumer.h>
+#include <linux/pm_qos.h>
 #include <linux/spi/spi.h>
 #include <linux/spinlock.h>
 #include <linux/types.h>
@@ -83,6 +93,80 @@
 #define SPI_HID_BUS_ERROR_RESET			6
 #define SPI_HID_BUS_ERROR_STOP			7
 
+/*
+ * Error recovery ladder, cheapest step first. RESYNC re-reads the input
+ * header from the input path, PROTOCOL_RESET re-runs the device descriptor
+ * handshake and HARD_RESET drives the reset line (or the ACPI/GPIO reset).
+ */
+#define SPI_HID_RECOVERY_NONE			0
+#define SPI_HID_RECOVERY_RESYNC			1
+#define SPI_HID_RECOVERY_PROTOCOL_RESET		2
+#define SPI_HID_RECOVERY_HARD_RESET		3
+#define SPI_HID_RECOVERY_STEPS			4
+
+/* SPI clock scaling rates */
+#define SPI_HID_CLK_IDLE			0
+#define SPI_HID_CLK_ACTIVE			1
+#define SPI_HID_CLK_RATES			2
+
+/* SPI clock calibration, one step per AMD SPI controller rate */
+#define SPI_HID_CLK_CAL_STEPS			9
+
+/* Bring-up timeline milestones, each recorded the first time it is hit */
+#define SPI_HID_TL_PROBE			0
+#define SPI_HID_TL_BRINGUP			1
+#define SPI_HID_TL_RESET_DEASSERT		2
+#define SPI_HID_TL_RESET_RESPONSE		3
+#define SPI_HID_TL_DEVICE_DESC			4
+#define SPI_HID_TL_CREATE_DEVICE		5
+#define SPI_HID_TL_LL_PARSE			6
+#define SPI_HID_TL_REPORT_DESC			7
+#define SPI_HID_TL_HID_CREATED			8
+#define SPI_HID_TL_LL_OPEN			9
+#define SPI_HID_TL_FIRST_INPUT			10
+#define SPI_HID_TL_STAGE_0			11	/* + MSHW0231 stage */
+#define SPI_HID_TL_MILESTONES			(SPI_HID_TL_STAGE_0 + \
+						 MSHW0231_STAGE_FULL_OPERATIONAL + 1)
+
+/* Input pipeline stages with a latency histogram each */
+#define SPI_HID_LAT_IRQ_TO_HEADER		0
+#define SPI_HID_LAT_HEADER			1
+#define SPI_HID_LAT_HEADER_TO_BODY		2
+#define SPI_HID_LAT_BODY			3
+#define SPI_HID_LAT_DELIVERY			4
+#define SPI_HID_LAT_TOTAL			5	/* IRQ to delivery */
+#define SPI_HID_LAT_STAGES			6
+/* Bucket n counts latencies in [2^(n-1), 2^n) ns */
+#define SPI_HID_LAT_BUCKETS			64
+
+/* Stall watchdog alarm reasons */
+#define SPI_HID_WD_STALL			0	/* heartbeats stopped */
+#define SPI_HID_WD_SLO				1	/* latency over SLO */
+#define SPI_HID_WD_REASONS			2
+
+/* Transport statistics counters */
+#define SPI_HID_STAT_IRQS			0
+#define SPI_HID_STAT_IRQS_COALESCED		1
+#define SPI_HID_STAT_REPORTS			2
+#define SPI_HID_STAT_BYTES_IN			3
+#define SPI_HID_STAT_OUTPUTS			4
+#define SPI_HID_STAT_BYTES_OUT			5
+#define SPI_HID_STAT_DROPS			6
+#define SPI_HID_STAT_BUS_ERRORS			7
+#define SPI_HID_STAT_LOGIC_ERRORS		8
+#define SPI_HID_STAT_REGULATOR_ERRORS		9
+#define SPI_HID_STAT_DEVICE_RESETS		10
+#define SPI_HID_STAT_COUNTERS			11
+#define SPI_HID_STAT_TYPES			16
+
+/* Reset phases, timed in order from the start of a reset */
+#define SPI_HID_RESET_PHASE_BACKOFF		0
+#define SPI_HID_RESET_PHASE_ASSERT		1
+#define SPI_HID_RESET_PHASE_RESPONSE		2
+#define SPI_HID_RESET_PHASE_DESCRIPTOR		3
+#define SPI_HID_RESET_PHASE_READY		4
+#define SPI_HID_RESET_PHASES			5
+
 /* Protocol constants */
 #define SPI_HID_READ_APPROVAL_CONSTANT		0xff
 #define SPI_HID_INPUT_HEADER_SYNC_BYTE		0x5a
@@ -123,6 +207,10 @@
 #define SPI_HID_POWER_SUPPORT_NO_RESP		0x02
 #define SPI_HID_POWER_SUPPORT_RESP		0x03
 
+/* wFlags: power support in bits 1:0, response delay (ms) in bits 15:8 */
+#define SPI_HID_DEV_DESC_POWER_SUPPORT_MASK	0x0003
+#define SPI_HID_DEV_DESC_POWER_DELAY_SHIFT	8
+
 #define SPI_HID_POWER_MODE_ACTIVE		0x01 /* "Active" - D0 */
 #define SPI_HID_POWER_MODE_SLEEP		0x02 /* "Doze" - D2 */
 #define SPI_HID_POWER_MODE_OFF			0x03
@@ -133,6 +221,7 @@
 #define SPI_HID_LEFT_SCREEN_TOUCH_HEAT_MAP_REPORT_ID 0X3C
 
 #define SPI_HID_MAX_LATENCIES			64
+#define SPI_HID_MAX_REPORT_DESC_LEN		SZ_8K
 
 #define SPI_HID_INPUT_STAGE_IDLE	0
 #define SPI_HID_INPUT_STAGE_BODY	1
@@ -197,6 +286,51 @@ struct spi_hid_output_report {
 	u8 *content;
 };
 
+/*
+ * A queued output request. Requests are serviced in FIFO order by the
+ * request worker, which is the only context that writes the output buffer
+ * and consumes the response slot. When @response is set, the response
+ * content is copied there (up to @response_size bytes) before @done is
+ * completed and @status holds the copied length, otherwise @status is 0
+ * on success. On failure @status is a negative error code. An @async
+ * request has no waiter; it carries its own copy of the content and is
+ * freed by the worker once sent and @delay_ms has passed.
+ */
+struct spi_hid_request {
+	struct list_head list;
+	u16 output_register;
+	struct spi_hid_output_report report;
+
+	u8 *response;
+	u16 response_size;
+
+	int status;
+	struct completion done;
+
+	bool async;
+	u32 delay_ms;
+	u8 content[];
+};
+
+/*
+ * Last known good descriptors. A device that comes back from reset with the
+ * same vendor/product/version_id and report descriptor length is assumed to
+ * be unchanged and is made ready from here, the full report descriptor is
+ * then refetched in the background to confirm it.
+ */
+struct spi_hid_desc_cache {
+	struct mutex lock;
+	bool valid;
+	struct spi_hid_device_descriptor desc;
+	u8 *report_desc;
+	u16 report_desc_len;
+	u32 crc32;
+
+	u32 hits;
+	u32 misses;
+	u32 stale;
+};
+
 struct spi_hid_input_header {
 	u8 version;
 	u8 report_type;
@@ -217,6 +351,26 @@ struct latency_instance {
 	u64 end_time;
 };
 
+/* One delivered input report, also the binary latency_log_bin record */
+struct spi_hid_lat_log_rec {
+	__u64 seq;
+	__u64 irq_ns;
+	__u64 delivered_ns;
+	__u16 signature;
+	__u8 report_id;
+	__u8 reserved[5];
+} __packed;
+
+struct spi_hid_stats {
+	u64 count[SPI_HID_STAT_COUNTERS];
+	u64 by_type[SPI_HID_STAT_TYPES];	/* input reports by report type */
+	u64 by_id[256];				/* data reports by report ID */
+};
+
+struct spi_hid_lat_hist {
+	u64 buckets[SPI_HID_LAT_STAGES][SPI_HID_LAT_BUCKETS];
+};
+
 struct spi_hid {
 	struct spi_device	*spi;
 	struct hid_device	*hid;
@@ -240,6 +394,17 @@ struct spi_hid {
 	u16 hid_desc_addr;
 	u8 power_state;
 	u8 attempts;
+	unsigned long last_reset_attempt;
+	struct completion reset_response;
+
+	bool reset_timing_active;
+	ktime_t reset_phase_start;
+	/* Stamped by the input path, marked later from process context */
+	ktime_t reset_response_time;
+	ktime_t reset_desc_time;
+	u32 reset_timing_count;
+	u64 reset_phase_last_us[SPI_HID_RESET_PHASES];
+	u64 reset_phase_max_us[SPI_HID_RESET_PHASES];
 
 	/*
 	* ready flag indicates that the FW is ready to accept commands and requests.
@@ -256,34 +421,164 @@ struct spi_hid {
 	bool irq_enabled;
 	int irq;
 
+	/*
+	* Runtime PM references held for the bring-up (until the HID device is
+	* created) and for the HID device while it is open. Idle devices are put
+	* to SLEEP first and only turned OFF by off_work after off_delay_ms.
+	* The bring-up reference is kept for open_grace_ms after the HID device
+	* is created so that a prompt first open finds the device still up.
+	*/
+	bool pm_bringup_ref;
+	bool pm_open_ref;
+	u32 off_delay_ms;
+	struct delayed_work off_work;
+	u32 open_grace_ms;
+	struct delayed_work grace_work;
+	u32 grace_hits;
+	u32 grace_misses;
+
+	/*
+	* Idle governor: an open device without input for idle_sleep_ms is put
+	* to SLEEP and woken again by its next IRQ. idle_sleeping is only set
+	* for governor sleeps, runtime PM sleeps are tracked by runtime PM.
+	*/
+	u32 idle_sleep_ms;
+	bool idle_sleeping;
+	struct delayed_work idle_work;
+	struct work_struct idle_wake_work;
+	u32 idle_sleeps;
+	u32 idle_wakes;
+	ktime_t idle_since;
+	u64 idle_residency_ns[2];
+
 	struct regulator *supply;
 	struct pinctrl *pinctrl;
 	struct pinctrl_state *pinctrl_reset;
 	struct pinctrl_state *pinctrl_active;
 	struct pinctrl_state *pinctrl_sleep;
+	/*
+	* All device work runs on a per-device unbound high priority
+	* workqueue, on the CPUs in wq_cpus.
+	*/
+	struct workqueue_struct *wq;
+	cpumask_var_t wq_cpus;
+	struct work_struct bringup_work;
 	struct work_struct reset_work;
 	struct work_struct create_device_work;
 	struct work_struct refresh_device_work;
+	struct work_struct desc_validate_work;
 	struct work_struct error_work;
 
 	struct mutex lock;
 	struct mutex power_lock;
 	struct completion output_done;
+	bool output_inflight;
+	struct completion response_done;
+
+	struct list_head request_queue;
+	spinlock_t request_lock;
+	struct work_struct request_work;
+	bool request_queue_dead;
 
 	__u8 read_approval[SPI_HID_READ_APPROVAL_LEN];
 
 	u32 report_descriptor_crc32;
+	struct spi_hid_desc_cache desc_cache;
 
-	u32 regulator_error_count;
-	int regulator_last_error;
+	struct dentry *debugfs;
+	atomic64_t timeline_ns[SPI_HID_TL_MILESTONES];
+	u64 timeline_last_ns;
 
-	u32 bus_error_count;
-	int bus_last_error;
+	/*
+	* Per-CPU input latency histograms. The timestamps are only touched
+	* under input_lock: lat_submit_ns is the last transfer submission,
+	* lat_header_ns and lat_body_ns the last header and body completion.
+	*/
+	struct spi_hid_lat_hist __percpu *lat_hist;
+	u64 lat_submit_ns;
+	u64 lat_header_ns;
+	u64 lat_body_ns;
+
+	/*
+	* Payload tracing captures one in trace_sample input frames and
+	* outputs (0: none, 1: all). trace_payload is the decision for the
+	* input frame in flight.
+	*/
+	u32 trace_sample;
+	u32 trace_sample_count;
+	bool trace_payload;
+
+	/*
+	* Stall watchdog. Once a heartbeat has been seen, wd_work fires if the
+	* next one is more than wd_timeout_ms late. wd_slo_frames consecutive
+	* reports over wd_slo_us IRQ-to-delivery latency raise an SLO alarm.
+	* Alarms latch their reason in wd_alarm_pending and value in
+	* wd_alarm_value; wd_alarm_work logs and notifies them and, with
+	* wd_recover, schedules a protocol reset.
+	*/
+	struct delayed_work wd_work;
+	struct work_struct wd_alarm_work;
+	unsigned long wd_alarm_pending;
+	u64 wd_alarm_value[SPI_HID_WD_REASONS];
+	u32 wd_timeout_ms;
+	u32 wd_slo_us;
+	u32 wd_slo_frames;
+	u32 wd_slo_streak;
+	bool wd_recover;
+	u64 wd_hb_last_ns;
+	u32 wd_hb_interval_ms;
+	u32 wd_heartbeats;
+	u32 wd_alarms[SPI_HID_WD_REASONS];
 
-	u32 logic_error_count;
+	/*
+	* Latency log, a ring of lat_log_depth (a power of two) records
+	* holding sequence numbers [lat_log_tail, lat_log_head). Consuming
+	* readers advance lat_log_tail, a full ring overwrites the oldest.
+	*/
+	spinlock_t lat_log_lock;
+	struct spi_hid_lat_log_rec *lat_log;
+	u32 lat_log_depth;
+	u64 lat_log_head;
+	u64 lat_log_tail;
+	u64 lat_log_dropped;
+	bool lat_log_consume;
+
+	/*
+	* Binary capture of every input and output transaction through a
+	* relay channel, see spi-hid-capture.h. capture_lock orders the
+	* records, capture_mutex serializes starting and stopping.
+	*/
+	spinlock_t capture_lock;
+	struct mutex capture_mutex;
+	struct rchan *capture;
+	bool capture_on;
+	u64 capture_seq;
+	u64 capture_dropped;
+	u64 replay_count;
+
+	/*
+	* Per-CPU transport statistics. The report and byte rates are
+	* recomputed at most once a second, under input_lock, from the
+	* counters as of stats_rate_ns.
+	*/
+	struct spi_hid_stats __percpu *stats;
+	u64 stats_rate_ns;
+	u64 stats_rate_reports;
+	u64 stats_rate_bytes;
+	u64 stats_reports_per_sec;
+	u64 stats_bytes_per_sec;
+
+	int regulator_last_error;
+	int bus_last_error;
 	int logic_last_error;
 
-	u32 dir_count;
+	spinlock_t recovery_lock;
+	unsigned long recovery_last;
+	u8 recovery_step;
+	bool recovery_pending;
+	u32 recovery_count[SPI_HID_RECOVERY_STEPS];
+	u32 recovery_coalesced;
+
 	u32 powered;
 
 	u64 interrupt_time_stamps[2];
@@ -291,6 +586,48 @@ struct spi_hid {
 	u8 latency_index;
 	u8 perf_mode;
 	u16 touch_signature_index;
+
+	/*
+	* Per-transfer SPI clock, 0 uses the device default. Picked from the
+	* low-latency override or the clock scaling rate for the current
+	* activity, under clk_lock.
+	*/
+	u32 xfer_speed_hz;
+
+	spinlock_t clk_lock;
+	struct delayed_work clk_idle_work;
+	u8 clk_state;
+	u32 clk_rate_hz[SPI_HID_CLK_RATES];
+	u32 clk_up_reports;
+	u32 clk_idle_ms;
+	u32 clk_burst;
+	u32 clk_switches;
+	ktime_t clk_since;
+	u64 clk_residency_ns[SPI_HID_CLK_RATES];
+
+	struct work_struct clk_cal_work;
+	u8 clk_cal_approval[SPI_HID_READ_APPROVAL_LEN];
+	struct spi_hid_input_buf clk_cal_buf;
+	u32 clk_cal_reads;
+	u32 clk_cal_errors[SPI_HID_CLK_CAL_STEPS];
+	u32 clk_cal_tested;
+	u32 clk_cal_speed_hz;
+	int clk_cal_status;
+	bool clk_cal_done;
+
+	/* Low-latency mode, engaged while input reports keep arriving */
+	struct mutex lowlat_lock;
+	struct pm_qos_request lowlat_qos;
+	struct work_struct lowlat_engage_work;
+	struct delayed_work lowlat_idle_work;
+	bool lowlat_mode;
+	bool lowlat_active;
+	bool lowlat_steered;
+	cpumask_var_t lowlat_affinity;
+	int lowlat_cpu;
+	u32 lowlat_idle_ms;
+	u32 lowlat_speed_hz;
+	u32 lowlat_engaged_count;
 	
 	/* MSHW0231 multi-collection support - Windows compatibility */
 	u8 target_collection;
@@ -302,6 +639,12 @@ struct spi_hid {
 	struct work_struct staged_init_work;
 	struct timer_list staging_timer;
 	u8 initialization_stage;
+	u8 staging_last_stage;
+	unsigned long staging_wait;	/* Events the current stage waits on */
+	unsigned long staging_seen;	/* Events since the stage started */
+	u32 staging_event;		/* Event that ended the last wait */
+	ktime_t staging_stage_start;
+	ktime_t staging_init_start;
 	u32 windows_irq_number;		/* IRQ 1033 from Windows traces */
 };
 
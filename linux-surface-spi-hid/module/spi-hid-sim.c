@@ -0,0 +1,867 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * spi-hid-sim.c - simulated HID over SPI peripheral
+ *
+ * Registers a software SPI controller with one "hid-over-spi" device on it,
+ * so the spi_hid driver can be brought up, benchmarked and fault tested
+ * without hardware. The device model answers read approvals with input
+ * headers and bodies and output writes with the responses the driver waits
+ * for, using the protocol constants from spi-hid-core.h:
+ *
+ *   reset GPIO deasserted		-> reset response
+ *   write to the descriptor register	-> device descriptor
+ *   write to the report descriptor reg	-> report descriptor
+ *   GET_FEATURE to the output register	-> get feature response
+ *
+ * Once the report descriptor has been read, an hrtimer streams data reports
+ * at rate_hz, optionally followed by heat maps and heartbeats. Every queued
+ * report raises the virtual IRQ, which is a GPIO line backed by irq_sim.
+ *
+ * Faults are injected on every Nth data report:
+ *   err_sync_every	the header's sync byte is wrong on its first read
+ *   err_version_every	the header carries version 0x0f on its first read
+ *   err_fffd_every	the body's content length is the 0xFFFD handshake
+ *
+ * The SPI device is named spiN.0, so the MSHW0231-only paths in the driver
+ * are not taken; 0xFFFD handshakes go through the generic oversized body
+ * handling.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/delay.h>
+#include <linux/gpio/driver.h>
+#include <linux/gpio/machine.h>
+#include <linux/hrtimer.h>
+#include <linux/interrupt.h>
+#include <linux/irq.h>
+#include <linux/irq_sim.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/platform_device.h>
+#include <linux/property.h>
+#include <linux/slab.h>
+#include <linux/spi/spi.h>
+#include <linux/spinlock.h>
+#include <linux/version.h>
+
+#include "spi-hid-core.h"
+
+#define SPI_HID_SIM_NAME		"spi-hid-sim"
+
+/* Registers of the simulated device */
+#define SPI_HID_SIM_DESC_REG		0x0001
+#define SPI_HID_SIM_REPORT_DESC_REG	0x0002
+#define SPI_HID_SIM_OUTPUT_REG		0x0003
+#define SPI_HID_SIM_COMMAND_REG		0x0004
+
+#define SPI_HID_SIM_VENDOR_ID		0x1209
+#define SPI_HID_SIM_PRODUCT_ID		0x5348
+#define SPI_HID_SIM_VERSION_ID		0x0001
+
+#define SPI_HID_SIM_DATA_REPORT_ID	0x01
+#define SPI_HID_SIM_FEATURE_REPORT_ID	0x02
+#define SPI_HID_SIM_FEATURE_LEN		8
+#define SPI_HID_SIM_HEARTBEAT_LEN	2
+
+/*
+* Content that fits the driver's input buffer with header and body. This is
+* also well inside the 16380 bytes a header's report length can express.
+*/
+#define SPI_HID_SIM_MAX_CONTENT		(SZ_8K - 16)
+#define SPI_HID_SIM_MAX_OUTPUT		64
+
+#define SPI_HID_SIM_QUEUE_LEN		64
+#define SPI_HID_SIM_SPEED_HZ		25000000
+#define SPI_HID_SIM_IDLE_TICK_MS	10
+#define SPI_HID_SIM_REASSERT_MS		100
+
+#define SPI_HID_SIM_GPIO_IRQ		0
+#define SPI_HID_SIM_GPIO_RESET		1
+#define SPI_HID_SIM_GPIOS		2
+
+/* Injected faults */
+#define SPI_HID_SIM_ERR_SYNC		BIT(0)
+#define SPI_HID_SIM_ERR_VERSION		BIT(1)
+#define SPI_HID_SIM_ERR_FFFD		BIT(2)
+#define SPI_HID_SIM_ERR_HEADER		(SPI_HID_SIM_ERR_SYNC | \
+					SPI_HID_SIM_ERR_VERSION)
+
+static unsigned int rate_hz = 120;
+module_param(rate_hz, uint, 0644);
+MODULE_PARM_DESC(rate_hz, "Data reports per second, 0 stops the stream");
+
+static unsigned int report_len = 64;
+module_param(report_len, uint, 0444);
+MODULE_PARM_DESC(report_len, "Content bytes of data report 0x01");
+
+static unsigned int heatmap_every;
+module_param(heatmap_every, uint, 0644);
+MODULE_PARM_DESC(heatmap_every,
+		"Follow every Nth data report with a heat map, alternating IDs 0x0A and 0x3C, 0 disables");
+
+static unsigned int heatmap_len = 4096;
+module_param(heatmap_len, uint, 0444);
+MODULE_PARM_DESC(heatmap_len, "Content bytes of heat map reports");
+
+static unsigned int fragment_len;
+module_param(fragment_len, uint, 0644);
+MODULE_PARM_DESC(fragment_len,
+		"Send data report content in fragments of this many bytes, 0 disables");
+
+static unsigned int heartbeat_ms = 1000;
+module_param(heartbeat_ms, uint, 0644);
+MODULE_PARM_DESC(heartbeat_ms, "Heartbeat report (0xFE) period, 0 disables");
+
+static unsigned int err_sync_every;
+module_param(err_sync_every, uint, 0644);
+MODULE_PARM_DESC(err_sync_every,
+		"Send a bad sync byte with every Nth data report, 0 disables");
+
+static unsigned int err_version_every;
+module_param(err_version_every, uint, 0644);
+MODULE_PARM_DESC(err_version_every,
+		"Send header version 0x0f with every Nth data report, 0 disables");
+
+static unsigned int err_fffd_every;
+module_param(err_fffd_every, uint, 0644);
+MODULE_PARM_DESC(err_fffd_every,
+		"Send every Nth data report as a 0xFFFD handshake, 0 disables");
+
+static bool bus_timing = true;
+module_param(bus_timing, bool, 0644);
+MODULE_PARM_DESC(bus_timing,
+		"Complete transfers after the time they take at their clock rate");
+
+struct spi_hid_sim_report {
+	u8 type;		/* SPI_HID_REPORT_TYPE_* */
+	u8 id;
+	u8 fragment;		/* header fragment_id, 0 if not fragmented */
+	u8 errors;		/* SPI_HID_SIM_ERR_* */
+	u16 len;		/* content bytes */
+	u16 offset;		/* of this fragment in the whole content */
+	u16 seq;
+};
+
+struct spi_hid_sim {
+	struct device *dev;
+	struct spi_controller *ctlr;
+	struct spi_device *spi;
+	struct gpio_chip gc;
+	struct gpiod_lookup_table *lookup;
+	struct irq_domain *irq_domain;
+	int irq;
+	struct hrtimer timer;
+	struct dentry *debugfs;
+
+	struct spi_hid_device_desc_raw dev_desc;
+	u8 report_desc[128];
+	u16 report_desc_len;
+
+	/* Protects everything below */
+	spinlock_t lock;
+	struct spi_hid_sim_report queue[SPI_HID_SIM_QUEUE_LEN];
+	unsigned int head;
+	unsigned int count;
+	bool irq_asserted;
+	u64 irq_ns;		/* last assert, or the last read since */
+	bool reset;		/* reset line asserted */
+	bool configured;	/* report descriptor has been read */
+	u8 power_state;
+	u16 seq;
+	unsigned long data_reports;
+	unsigned long heatmaps;
+	u64 heartbeat_ns;
+
+	u64 reports;
+	u64 dropped;
+	u64 injected;
+	u64 bad_reads;
+	u64 bad_writes;
+};
+
+static const struct property_entry spi_hid_sim_props[] = {
+	PROPERTY_ENTRY_U32("hid-descr-addr", SPI_HID_SIM_DESC_REG),
+	{ }
+};
+
+static const struct software_node spi_hid_sim_swnode = {
+	.properties = spi_hid_sim_props,
+};
+
+static void spi_hid_sim_irq(struct spi_hid_sim *sim)
+{
+	irq_set_irqchip_state(sim->irq, IRQCHIP_STATE_PENDING, true);
+}
+
+/*
+* Queues a report, split into fragment_len sized fragments for data reports.
+* Called with sim->lock held, returns true if the IRQ has to be raised.
+*/
+static bool spi_hid_sim_queue(struct spi_hid_sim *sim, u8 type, u8 id,
+		u16 len, u8 errors)
+{
+	unsigned int frag = READ_ONCE(fragment_len);
+	struct spi_hid_sim_report *r;
+	u16 offset = 0;
+	u8 fragment = 0;
+
+	if (type != SPI_HID_REPORT_TYPE_DATA || !frag || frag >= len)
+		frag = len;
+
+	do {
+		if (sim->count == SPI_HID_SIM_QUEUE_LEN) {
+			sim->dropped++;
+			break;
+		}
+
+		r = &sim->queue[(sim->head + sim->count++) %
+				SPI_HID_SIM_QUEUE_LEN];
+		r->type = type;
+		r->id = id;
+		r->len = min_t(unsigned int, len - offset, frag);
+		r->offset = offset;
+		r->seq = sim->seq;
+		r->fragment = frag < len ? ++fragment & 0xf : 0;
+		r->errors = offset ? 0 : errors;
+		offset += r->len;
+	} while (offset < len);
+
+	sim->seq++;
+
+	if (sim->irq_asserted || !sim->count)
+		return false;
+
+	sim->irq_asserted = true;
+	sim->irq_ns = ktime_get_ns();
+
+	return true;
+}
+
+static bool spi_hid_sim_every(unsigned int *n, unsigned long count)
+{
+	unsigned int every = READ_ONCE(*n);
+
+	return every && count % every == 0;
+}
+
+/* Called with sim->lock held */
+static bool spi_hid_sim_queue_data(struct spi_hid_sim *sim, u8 id, u16 len)
+{
+	unsigned long n = ++sim->data_reports;
+	u8 errors = 0;
+
+	if (spi_hid_sim_every(&err_sync_every, n))
+		errors |= SPI_HID_SIM_ERR_SYNC;
+	if (spi_hid_sim_every(&err_version_every, n))
+		errors |= SPI_HID_SIM_ERR_VERSION;
+	if (spi_hid_sim_every(&err_fffd_every, n))
+		errors |= SPI_HID_SIM_ERR_FFFD;
+
+	return spi_hid_sim_queue(sim, SPI_HID_REPORT_TYPE_DATA, id, len,
+			errors);
+}
+
+static enum hrtimer_restart spi_hid_sim_tick(struct hrtimer *timer)
+{
+	struct spi_hid_sim *sim = container_of(timer, struct spi_hid_sim,
+			timer);
+	unsigned int rate = READ_ONCE(rate_hz);
+	unsigned int hb_ms = READ_ONCE(heartbeat_ms);
+	u64 now = ktime_get_ns();
+	unsigned long flags;
+	bool fire = false;
+	u8 id;
+
+	spin_lock_irqsave(&sim->lock, flags);
+
+	if (sim->configured && !sim->reset &&
+			sim->power_state == SPI_HID_POWER_MODE_ACTIVE) {
+		if (rate) {
+			fire |= spi_hid_sim_queue_data(sim,
+					SPI_HID_SIM_DATA_REPORT_ID, report_len);
+
+			if (spi_hid_sim_every(&heatmap_every,
+					sim->data_reports)) {
+				id = SPI_HID_RIGHT_SCREEN_TOUCH_HEAT_MAP_REPORT_ID;
+				if (sim->heatmaps++ & 1)
+					id = SPI_HID_LEFT_SCREEN_TOUCH_HEAT_MAP_REPORT_ID;
+				fire |= spi_hid_sim_queue_data(sim, id,
+						heatmap_len);
+			}
+		}
+
+		if (hb_ms && now - sim->heartbeat_ns >=
+				(u64)hb_ms * NSEC_PER_MSEC) {
+			sim->heartbeat_ns = now;
+			fire |= spi_hid_sim_queue(sim, SPI_HID_REPORT_TYPE_DATA,
+					SPI_HID_HEARTBEAT_REPORT_ID,
+					SPI_HID_SIM_HEARTBEAT_LEN, 0);
+		}
+	}
+
+	/*
+	* irq_sim drops edges while the line is masked, for example while the
+	* driver has disabled its IRQ. Like a level triggered line, raise it
+	* again when a pending report has not been read for a while.
+	*/
+	if (!fire && sim->irq_asserted && now - sim->irq_ns >
+			SPI_HID_SIM_REASSERT_MS * NSEC_PER_MSEC) {
+		sim->irq_ns = now;
+		fire = true;
+	}
+
+	spin_unlock_irqrestore(&sim->lock, flags);
+
+	if (fire)
+		spi_hid_sim_irq(sim);
+
+	hrtimer_forward_now(timer, rate ? ns_to_ktime(NSEC_PER_SEC / rate) :
+			ms_to_ktime(SPI_HID_SIM_IDLE_TICK_MS));
+
+	return HRTIMER_RESTART;
+}
+
+/* Reports take at least 8 bytes, so a body read never looks like a header */
+static u16 spi_hid_sim_report_length(const struct spi_hid_sim_report *r)
+{
+	return max_t(u16, round_up(SPI_HID_INPUT_BODY_LEN + r->len, 4),
+			2 * SPI_HID_INPUT_HEADER_LEN);
+}
+
+static void spi_hid_sim_header(const struct spi_hid_sim_report *r, u8 *buf)
+{
+	u16 units = spi_hid_sim_report_length(r) / 4;
+	u8 version = SPI_HID_INPUT_HEADER_VERSION;
+	u8 sync = SPI_HID_INPUT_HEADER_SYNC_BYTE;
+
+	/* 0xff has a meaning of its own to the driver, so use its complement */
+	if (r->errors & SPI_HID_SIM_ERR_SYNC)
+		sync = ~SPI_HID_INPUT_HEADER_SYNC_BYTE;
+	if (r->errors & SPI_HID_SIM_ERR_VERSION)
+		version = 0x0f;
+
+	buf[0] = version | (r->type << 4);
+	buf[1] = r->fragment | ((units & 0xf) << 4);
+	buf[2] = units >> 4;
+	buf[3] = sync;
+}
+
+static void spi_hid_sim_body(struct spi_hid_sim *sim,
+		const struct spi_hid_sim_report *r, u8 *buf, unsigned int len)
+{
+	u16 content_length = SPI_HID_INPUT_BODY_LEN + r->len;
+	u8 *content = buf + SPI_HID_INPUT_BODY_LEN;
+	unsigned int n, i;
+
+	memset(buf, 0, len);
+	if (len < SPI_HID_INPUT_BODY_LEN)
+		return;
+
+	if (r->errors & SPI_HID_SIM_ERR_FFFD)
+		content_length = 0xfffd;
+
+	buf[0] = content_length & 0xff;
+	buf[1] = content_length >> 8;
+	buf[2] = r->id;
+
+	n = min_t(unsigned int, r->len, len - SPI_HID_INPUT_BODY_LEN);
+
+	switch (r->type) {
+	case SPI_HID_REPORT_TYPE_DEVICE_DESC:
+		memcpy(content, &sim->dev_desc,
+				min_t(unsigned int, n, sizeof(sim->dev_desc)));
+		break;
+	case SPI_HID_REPORT_TYPE_REPORT_DESC:
+		memcpy(content, sim->report_desc,
+				min_t(unsigned int, n, sim->report_desc_len));
+		break;
+	case SPI_HID_REPORT_TYPE_DATA:
+		for (i = 0; i < n; i++)
+			content[i] = r->seq + r->offset + i;
+
+		/* The driver's latency log takes the first two as signature */
+		if (!r->offset && n >= 2) {
+			content[0] = r->seq & 0xff;
+			content[1] = r->seq >> 8;
+		}
+		break;
+	}
+}
+
+/*
+* A 4 byte read is a header, anything else the body of the report at the
+* head of the queue. A header with an injected fault is only sent once, the
+* driver's resync read gets the clean one.
+*/
+static void spi_hid_sim_read(struct spi_hid_sim *sim, const u8 *approval,
+		u8 *buf, unsigned int len)
+{
+	struct spi_hid_sim_report r;
+	unsigned long flags;
+	bool body = len != SPI_HID_INPUT_HEADER_LEN;
+	bool fire = false;
+	u32 reg;
+
+	reg = (approval[1] << 16) | (approval[2] << 8) | approval[3];
+
+	spin_lock_irqsave(&sim->lock, flags);
+
+	if (approval[4] != SPI_HID_READ_APPROVAL_CONSTANT ||
+			reg != SPI_HID_DEFAULT_INPUT_REGISTER || sim->reset) {
+		sim->bad_reads++;
+		spin_unlock_irqrestore(&sim->lock, flags);
+		memset(buf, 0, len);
+		return;
+	}
+
+	if (!sim->count) {
+		spin_unlock_irqrestore(&sim->lock, flags);
+		memset(buf, 0, len);
+		return;
+	}
+
+	r = sim->queue[sim->head];
+	sim->irq_ns = ktime_get_ns();
+
+	if (!body) {
+		if (r.errors & SPI_HID_SIM_ERR_HEADER)
+			sim->injected++;
+		sim->queue[sim->head].errors &= ~SPI_HID_SIM_ERR_HEADER;
+	} else {
+		if (r.errors & SPI_HID_SIM_ERR_FFFD)
+			sim->injected++;
+		if (r.type == SPI_HID_REPORT_TYPE_REPORT_DESC)
+			sim->configured = true;
+
+		sim->head = (sim->head + 1) % SPI_HID_SIM_QUEUE_LEN;
+		sim->count--;
+		sim->reports++;
+		sim->irq_asserted = fire = sim->count > 0;
+	}
+
+	spin_unlock_irqrestore(&sim->lock, flags);
+
+	if (body)
+		spi_hid_sim_body(sim, &r, buf, len);
+	else
+		spi_hid_sim_header(&r, buf);
+
+	if (fire)
+		spi_hid_sim_irq(sim);
+}
+
+static void spi_hid_sim_write(struct spi_hid_sim *sim, const u8 *buf,
+		unsigned int len)
+{
+	const u8 *body = buf + SPI_HID_OUTPUT_HEADER_LEN;
+	u16 content_length;
+	unsigned long flags;
+	bool fire = false;
+	u32 reg;
+
+	if (len < SPI_HID_OUTPUT_HEADER_LEN + SPI_HID_OUTPUT_BODY_LEN ||
+			(buf[4] & 0xf) != SPI_HID_OUTPUT_HEADER_VERSION) {
+		spin_lock_irqsave(&sim->lock, flags);
+		sim->bad_writes++;
+		spin_unlock_irqrestore(&sim->lock, flags);
+		return;
+	}
+
+	reg = (buf[1] << 16) | (buf[2] << 8) | buf[3];
+	content_length = body[1] | (body[2] << 8);
+
+	spin_lock_irqsave(&sim->lock, flags);
+
+	switch (reg) {
+	case SPI_HID_SIM_DESC_REG:
+		fire = spi_hid_sim_queue(sim, SPI_HID_REPORT_TYPE_DEVICE_DESC,
+				0, sizeof(sim->dev_desc), 0);
+		break;
+	case SPI_HID_SIM_REPORT_DESC_REG:
+		fire = spi_hid_sim_queue(sim, SPI_HID_REPORT_TYPE_REPORT_DESC,
+				0, sim->report_desc_len, 0);
+		break;
+	case SPI_HID_SIM_OUTPUT_REG:
+		if (body[0] == SPI_HID_CONTENT_TYPE_GET_FEATURE)
+			fire = spi_hid_sim_queue(sim,
+					SPI_HID_REPORT_TYPE_GET_FEATURE_RESP,
+					body[3], SPI_HID_SIM_FEATURE_LEN, 0);
+		else if (body[0] == SPI_HID_CONTENT_TYPE_COMMAND &&
+				body[3] == SPI_HID_COMMAND_SET_POWER &&
+				content_length > 3 &&
+				len > SPI_HID_OUTPUT_HEADER_LEN +
+				SPI_HID_OUTPUT_BODY_LEN)
+			sim->power_state = body[SPI_HID_OUTPUT_BODY_LEN];
+		break;
+	default:
+		sim->bad_writes++;
+		break;
+	}
+
+	spin_unlock_irqrestore(&sim->lock, flags);
+
+	if (fire)
+		spi_hid_sim_irq(sim);
+}
+
+static int spi_hid_sim_transfer_one_message(struct spi_controller *ctlr,
+		struct spi_message *msg)
+{
+	struct spi_hid_sim *sim = spi_controller_get_devdata(ctlr);
+	struct spi_transfer *xfer, *next;
+	u64 bus_ns = 0;
+
+	msg->actual_length = 0;
+
+	list_for_each_entry(xfer, &msg->transfers, transfer_list) {
+		msg->actual_length += xfer->len;
+		if (xfer->speed_hz)
+			bus_ns += div_u64((u64)xfer->len * 8 * NSEC_PER_SEC,
+					xfer->speed_hz);
+	}
+
+	xfer = list_first_entry(&msg->transfers, struct spi_transfer,
+			transfer_list);
+
+	if (xfer->tx_buf && xfer->len == SPI_HID_READ_APPROVAL_LEN &&
+			((u8 *)xfer->tx_buf)[0] ==
+			SPI_HID_READ_APPROVAL_OPCODE_READ &&
+			!list_is_last(&xfer->transfer_list, &msg->transfers)) {
+		next = list_next_entry(xfer, transfer_list);
+		if (next->rx_buf)
+			spi_hid_sim_read(sim, xfer->tx_buf, next->rx_buf,
+					next->len);
+	} else if (xfer->tx_buf && xfer->len &&
+			((u8 *)xfer->tx_buf)[0] ==
+			SPI_HID_OUTPUT_HEADER_OPCODE_WRITE) {
+		spi_hid_sim_write(sim, xfer->tx_buf, xfer->len);
+	} else {
+		list_for_each_entry(xfer, &msg->transfers, transfer_list)
+			if (xfer->rx_buf)
+				memset(xfer->rx_buf, 0, xfer->len);
+	}
+
+	if (READ_ONCE(bus_timing) && bus_ns >= NSEC_PER_USEC)
+		fsleep(div_u64(bus_ns, NSEC_PER_USEC));
+
+	msg->status = 0;
+	spi_finalize_current_message(ctlr);
+
+	return 0;
+}
+
+static int spi_hid_sim_gpio_get(struct gpio_chip *gc, unsigned int offset)
+{
+	struct spi_hid_sim *sim = gpiochip_get_data(gc);
+
+	if (offset == SPI_HID_SIM_GPIO_IRQ)
+		return READ_ONCE(sim->irq_asserted);
+
+	return READ_ONCE(sim->reset);
+}
+
+/* Asserting reset drops everything queued, deasserting sends the response */
+static void spi_hid_sim_set_reset(struct spi_hid_sim *sim, bool reset)
+{
+	unsigned long flags;
+	bool fire = false;
+
+	spin_lock_irqsave(&sim->lock, flags);
+
+	if (reset) {
+		sim->count = 0;
+		sim->irq_asserted = false;
+		sim->configured = false;
+		sim->power_state = SPI_HID_POWER_MODE_ACTIVE;
+	} else if (sim->reset) {
+		fire = spi_hid_sim_queue(sim, SPI_HID_REPORT_TYPE_RESET_RESP,
+				0, 0, 0);
+	}
+	sim->reset = reset;
+
+	spin_unlock_irqrestore(&sim->lock, flags);
+
+	if (fire)
+		spi_hid_sim_irq(sim);
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 17, 0)
+static int spi_hid_sim_gpio_set(struct gpio_chip *gc, unsigned int offset,
+		int value)
+{
+	if (offset == SPI_HID_SIM_GPIO_RESET)
+		spi_hid_sim_set_reset(gpiochip_get_data(gc), value);
+
+	return 0;
+}
+#else
+static void spi_hid_sim_gpio_set(struct gpio_chip *gc, unsigned int offset,
+		int value)
+{
+	if (offset == SPI_HID_SIM_GPIO_RESET)
+		spi_hid_sim_set_reset(gpiochip_get_data(gc), value);
+}
+#endif
+
+static int spi_hid_sim_gpio_get_direction(struct gpio_chip *gc,
+		unsigned int offset)
+{
+	return offset == SPI_HID_SIM_GPIO_IRQ ? GPIO_LINE_DIRECTION_IN :
+			GPIO_LINE_DIRECTION_OUT;
+}
+
+static int spi_hid_sim_gpio_to_irq(struct gpio_chip *gc, unsigned int offset)
+{
+	struct spi_hid_sim *sim = gpiochip_get_data(gc);
+
+	return offset == SPI_HID_SIM_GPIO_IRQ ? sim->irq : -ENXIO;
+}
+
+/* One vendor defined application collection per report */
+static unsigned int spi_hid_sim_report_desc_add(u8 *buf, u8 id, u16 count,
+		bool feature)
+{
+	u8 *p = buf;
+
+	*p++ = 0x06; *p++ = 0x00; *p++ = 0xff;	/* Usage Page (0xff00) */
+	*p++ = 0x09; *p++ = id;			/* Usage (id) */
+	*p++ = 0xa1; *p++ = 0x01;		/* Collection (Application) */
+	*p++ = 0x85; *p++ = id;			/* Report ID (id) */
+	*p++ = 0x15; *p++ = 0x00;		/* Logical Minimum (0) */
+	*p++ = 0x26; *p++ = 0xff; *p++ = 0x00;	/* Logical Maximum (255) */
+	*p++ = 0x75; *p++ = 0x08;		/* Report Size (8) */
+	*p++ = 0x96; *p++ = count & 0xff;	/* Report Count (count) */
+	*p++ = count >> 8;
+	*p++ = 0x09; *p++ = 0x01;		/* Usage (1) */
+	*p++ = feature ? 0xb1 : 0x81;		/* Feature or Input */
+	*p++ = 0x02;				/* (Data, Var, Abs) */
+	*p++ = 0xc0;				/* End Collection */
+
+	return p - buf;
+}
+
+static void spi_hid_sim_init_descriptors(struct spi_hid_sim *sim)
+{
+	struct spi_hid_device_desc_raw *desc = &sim->dev_desc;
+	u8 *p = sim->report_desc;
+
+	p += spi_hid_sim_report_desc_add(p, SPI_HID_SIM_DATA_REPORT_ID,
+			report_len, false);
+	p += spi_hid_sim_report_desc_add(p,
+			SPI_HID_RIGHT_SCREEN_TOUCH_HEAT_MAP_REPORT_ID,
+			heatmap_len, false);
+	p += spi_hid_sim_report_desc_add(p,
+			SPI_HID_LEFT_SCREEN_TOUCH_HEAT_MAP_REPORT_ID,
+			heatmap_len, false);
+	p += spi_hid_sim_report_desc_add(p, SPI_HID_HEARTBEAT_REPORT_ID,
+			SPI_HID_SIM_HEARTBEAT_LEN, false);
+	p += spi_hid_sim_report_desc_add(p, SPI_HID_SIM_FEATURE_REPORT_ID,
+			SPI_HID_SIM_FEATURE_LEN, true);
+	sim->report_desc_len = p - sim->report_desc;
+
+	desc->wDeviceDescLength = cpu_to_le16(sizeof(*desc));
+	desc->bcdVersion = cpu_to_le16(SPI_HID_SUPPORTED_VERSION);
+	desc->wReportDescLength = cpu_to_le16(sim->report_desc_len);
+	desc->wReportDescRegister = cpu_to_le16(SPI_HID_SIM_REPORT_DESC_REG);
+	desc->wInputRegister = cpu_to_le16(SPI_HID_DEFAULT_INPUT_REGISTER);
+	desc->wMaxInputLength = cpu_to_le16(SPI_HID_INPUT_BODY_LEN +
+			max(report_len, heatmap_len));
+	desc->wOutputRegister = cpu_to_le16(SPI_HID_SIM_OUTPUT_REG);
+	desc->wMaxOutputLength = cpu_to_le16(SPI_HID_SIM_MAX_OUTPUT);
+	desc->wCommandRegister = cpu_to_le16(SPI_HID_SIM_COMMAND_REG);
+	desc->wVendorID = cpu_to_le16(SPI_HID_SIM_VENDOR_ID);
+	desc->wProductID = cpu_to_le16(SPI_HID_SIM_PRODUCT_ID);
+	desc->wVersionID = cpu_to_le16(SPI_HID_SIM_VERSION_ID);
+	/* SET_POWER is applied silently, without a command response */
+	desc->wFlags = cpu_to_le16(SPI_HID_POWER_SUPPORT_NO_RESP);
+}
+
+static void spi_hid_sim_dispose_irq(void *data)
+{
+	struct spi_hid_sim *sim = data;
+
+	irq_dispose_mapping(sim->irq);
+}
+
+static void spi_hid_sim_remove_lookup(void *data)
+{
+	struct spi_hid_sim *sim = data;
+
+	gpiod_remove_lookup_table(sim->lookup);
+}
+
+static void spi_hid_sim_unregister(void *data)
+{
+	struct spi_hid_sim *sim = data;
+
+	spi_unregister_device(sim->spi);
+}
+
+static void spi_hid_sim_stop(void *data)
+{
+	struct spi_hid_sim *sim = data;
+
+	hrtimer_cancel(&sim->timer);
+	debugfs_remove_recursive(sim->debugfs);
+}
+
+static int spi_hid_sim_probe(struct platform_device *pdev)
+{
+	struct spi_board_info info = {
+		.modalias = "hid-over-spi",
+		.max_speed_hz = SPI_HID_SIM_SPEED_HZ,
+		.swnode = &spi_hid_sim_swnode,
+	};
+	struct device *dev = &pdev->dev;
+	struct spi_controller *ctlr;
+	struct spi_hid_sim *sim;
+	int ret;
+
+	ctlr = devm_spi_alloc_host(dev, sizeof(*sim));
+	if (!ctlr)
+		return -ENOMEM;
+
+	sim = spi_controller_get_devdata(ctlr);
+	sim->dev = dev;
+	sim->ctlr = ctlr;
+	sim->power_state = SPI_HID_POWER_MODE_ACTIVE;
+	spin_lock_init(&sim->lock);
+	spi_hid_sim_init_descriptors(sim);
+
+	sim->irq_domain = devm_irq_domain_create_sim(dev, NULL, 1);
+	if (IS_ERR(sim->irq_domain))
+		return PTR_ERR(sim->irq_domain);
+
+	sim->irq = irq_create_mapping(sim->irq_domain, 0);
+	if (!sim->irq)
+		return -ENXIO;
+
+	ret = devm_add_action_or_reset(dev, spi_hid_sim_dispose_irq, sim);
+	if (ret)
+		return ret;
+
+	sim->gc.label = SPI_HID_SIM_NAME;
+	sim->gc.parent = dev;
+	sim->gc.owner = THIS_MODULE;
+	sim->gc.base = -1;
+	sim->gc.ngpio = SPI_HID_SIM_GPIOS;
+	sim->gc.get = spi_hid_sim_gpio_get;
+	sim->gc.set = spi_hid_sim_gpio_set;
+	sim->gc.get_direction = spi_hid_sim_gpio_get_direction;
+	sim->gc.to_irq = spi_hid_sim_gpio_to_irq;
+
+	ret = devm_gpiochip_add_data(dev, &sim->gc, sim);
+	if (ret)
+		return ret;
+
+	ctlr->bus_num = -1;
+	ctlr->num_chipselect = 1;
+	ctlr->mode_bits = SPI_CPOL | SPI_CPHA;
+	ctlr->bits_per_word_mask = SPI_BPW_MASK(8);
+	ctlr->max_speed_hz = SPI_HID_SIM_SPEED_HZ;
+	ctlr->transfer_one_message = spi_hid_sim_transfer_one_message;
+
+	ret = devm_spi_register_controller(dev, ctlr);
+	if (ret)
+		return ret;
+
+	/*
+	* The driver looks its IRQ up as GPIO 0 without a name, and the reset
+	* line by name. Lookups without a name match any, so reset goes first.
+	*/
+	sim->lookup = devm_kzalloc(dev, struct_size(sim->lookup, table, 3),
+			GFP_KERNEL);
+	if (!sim->lookup)
+		return -ENOMEM;
+
+	sim->lookup->dev_id = devm_kasprintf(dev, GFP_KERNEL, "spi%u.0",
+			ctlr->bus_num);
+	if (!sim->lookup->dev_id)
+		return -ENOMEM;
+
+	sim->lookup->table[0] = GPIO_LOOKUP(SPI_HID_SIM_NAME,
+			SPI_HID_SIM_GPIO_RESET, "reset", GPIO_ACTIVE_HIGH);
+	sim->lookup->table[1] = GPIO_LOOKUP_IDX(SPI_HID_SIM_NAME,
+			SPI_HID_SIM_GPIO_IRQ, NULL, 0, GPIO_ACTIVE_HIGH);
+	gpiod_add_lookup_table(sim->lookup);
+
+	ret = devm_add_action_or_reset(dev, spi_hid_sim_remove_lookup, sim);
+	if (ret)
+		return ret;
+
+	sim->spi = spi_new_device(ctlr, &info);
+	if (!sim->spi)
+		return -ENODEV;
+
+	ret = devm_add_action_or_reset(dev, spi_hid_sim_unregister, sim);
+	if (ret)
+		return ret;
+
+	sim->debugfs = debugfs_create_dir(SPI_HID_SIM_NAME, NULL);
+	debugfs_create_u64("reports", 0444, sim->debugfs, &sim->reports);
+	debugfs_create_u64("dropped", 0444, sim->debugfs, &sim->dropped);
+	debugfs_create_u64("injected", 0444, sim->debugfs, &sim->injected);
+	debugfs_create_u64("bad_reads", 0444, sim->debugfs, &sim->bad_reads);
+	debugfs_create_u64("bad_writes", 0444, sim->debugfs,
+			&sim->bad_writes);
+
+	hrtimer_setup(&sim->timer, spi_hid_sim_tick, CLOCK_MONOTONIC,
+			HRTIMER_MODE_REL);
+	hrtimer_start(&sim->timer, ms_to_ktime(SPI_HID_SIM_IDLE_TICK_MS),
+			HRTIMER_MODE_REL);
+
+	ret = devm_add_action_or_reset(dev, spi_hid_sim_stop, sim);
+	if (ret)
+		return ret;
+
+	dev_info(dev, "simulating %s at %u Hz, %u byte reports\n",
+			dev_name(&sim->spi->dev), rate_hz, report_len);
+
+	return 0;
+}
+
+static struct platform_driver spi_hid_sim_driver = {
+	.driver = {
+		.name	= SPI_HID_SIM_NAME,
+	},
+	.probe		= spi_hid_sim_probe,
+};
+
+static struct platform_device *spi_hid_sim_pdev;
+
+static int __init spi_hid_sim_init(void)
+{
+	int ret;
+
+	/* Report lengths are carried as u16 and must fit the driver's buffer */
+	if (report_len < 2 || report_len > SPI_HID_SIM_MAX_CONTENT ||
+			heatmap_len < 2 || heatmap_len > SPI_HID_SIM_MAX_CONTENT) {
+		pr_err("%s: report_len and heatmap_len must be 2 to %u\n",
+				SPI_HID_SIM_NAME, SPI_HID_SIM_MAX_CONTENT);
+		return -EINVAL;
+	}
+
+	ret = platform_driver_register(&spi_hid_sim_driver);
+	if (ret)
+		return ret;
+
+	spi_hid_sim_pdev = platform_device_register_simple(SPI_HID_SIM_NAME,
+			PLATFORM_DEVID_NONE, NULL, 0);
+	if (IS_ERR(spi_hid_sim_pdev)) {
+		platform_driver_unregister(&spi_hid_sim_driver);
+		return PTR_ERR(spi_hid_sim_pdev);
+	}
+
+	return 0;
+}
+module_init(spi_hid_sim_init);
+
+static void __exit spi_hid_sim_exit(void)
+{
+	platform_device_unregister(spi_hid_sim_pdev);
+	platform_driver_unregister(&spi_hid_sim_driver);
+}
+module_exit(spi_hid_sim_exit);
+
+MODULE_DESCRIPTION("Simulated HID over SPI peripheral");
+MODULE_LICENSE("GPL");
@@ -81,6 +81,74 @@ DEFINE_EVENT(spi_hid_transfer, spi_hid_output_end,
 	TP_ARGS(shid, tx_buf, tx_len, rx_buf, rx_len, ret)
 );
 
+/*
+* Header-only variants of the transfer events. They record lengths, the
+* report type and the report ID (0 where not known yet) instead of the
+* payload, and fire for every transfer. The payload events above only
+* fire for the transfers picked by spi_hid_trace_sample.
+*/
+DECLARE_EVENT_CLASS(spi_hid_transfer_hdr,
+	TP_PROTO(struct spi_hid *shid, int tx_len, u16 rx_len, u8 report_type,
+			u8 report_id, int ret),
+
+	TP_ARGS(shid, tx_len, rx_len, report_type, report_id, ret),
+
+	TP_STRUCT__entry(
+		__field(int, bus_num)
+		__field(int, chip_select)
+		__field(int, tx_len)
+		__field(u16, rx_len)
+		__field(u8, report_type)
+		__field(u8, report_id)
+		__field(int, ret)
+	),
+
+	TP_fast_assign(
+		__entry->bus_num = shid->spi->controller->bus_num;
+		__entry->chip_select = shid->spi->chip_select[0];
+		__entry->tx_len = tx_len;
+		__entry->rx_len = rx_len;
+		__entry->report_type = report_type;
+		__entry->report_id = report_id;
+		__entry->ret = ret;
+	),
+
+	TP_printk("spi%d.%d: tx=%d rx=%u type=0x%02x id=0x%02x --> %d",
+		__entry->bus_num, __entry->chip_select, __entry->tx_len,
+		__entry->rx_len, __entry->report_type, __entry->report_id,
+		__entry->ret)
+);
+
+DEFINE_EVENT(spi_hid_transfer_hdr, spi_hid_input_async_hdr,
+	TP_PROTO(struct spi_hid *shid, int tx_len, u16 rx_len, u8 report_type,
+			u8 report_id, int ret),
+	TP_ARGS(shid, tx_len, rx_len, report_type, report_id, ret)
+);
+
+DEFINE_EVENT(spi_hid_transfer_hdr, spi_hid_input_header_complete_hdr,
+	TP_PROTO(struct spi_hid *shid, int tx_len, u16 rx_len, u8 report_type,
+			u8 report_id, int ret),
+	TP_ARGS(shid, tx_len, rx_len, report_type, report_id, ret)
+);
+
+DEFINE_EVENT(spi_hid_transfer_hdr, spi_hid_input_body_complete_hdr,
+	TP_PROTO(struct spi_hid *shid, int tx_len, u16 rx_len, u8 report_type,
+			u8 report_id, int ret),
+	TP_ARGS(shid, tx_len, rx_len, report_type, report_id, ret)
+);
+
+DEFINE_EVENT(spi_hid_transfer_hdr, spi_hid_output_begin_hdr,
+	TP_PROTO(struct spi_hid *shid, int tx_len, u16 rx_len, u8 report_type,
+			u8 report_id, int ret),
+	TP_ARGS(shid, tx_len, rx_len, report_type, report_id, ret)
+);
+
+DEFINE_EVENT(spi_hid_transfer_hdr, spi_hid_output_end_hdr,
+	TP_PROTO(struct spi_hid *shid, int tx_len, u16 rx_len, u8 report_type,
+			u8 report_id, int ret),
+	TP_ARGS(shid, tx_len, rx_len, report_type, report_id, ret)
+);
+
 DECLARE_EVENT_CLASS(spi_hid_irq,
 	TP_PROTO(struct spi_hid *shid, int irq),
 
@@ -192,6 +260,123 @@ DEFINE_EVENT(spi_hid, spi_hid_response_handler,
 	TP_ARGS(shid)
 );
 
+TRACE_EVENT(spi_hid_staged_init_stage,
+	TP_PROTO(struct spi_hid *shid, u8 stage, u32 event, u64 duration_us),
+
+	TP_ARGS(shid, stage, event, duration_us),
+
+	TP_STRUCT__entry(
+		__field(int, bus_num)
+		__field(int, chip_select)
+		__field(u8, stage)
+		__field(u32, event)
+		__field(u64, duration_us)
+	),
+
+	TP_fast_assign(
+		__entry->bus_num = shid->spi->controller->bus_num;
+		__entry->chip_select = shid->spi->chip_select[0];
+		__entry->stage = stage;
+		__entry->event = event;
+		__entry->duration_us = duration_us;
+	),
+
+	TP_printk("spi%d.%d: stage %u took %llu us, ended by event %u",
+		__entry->bus_num, __entry->chip_select, __entry->stage,
+		__entry->duration_us, __entry->event)
+);
+
+TRACE_EVENT(spi_hid_timeline,
+	TP_PROTO(struct spi_hid *shid, u8 milestone, u64 since_probe_us,
+			u64 delta_us),
+
+	TP_ARGS(shid, milestone, since_probe_us, delta_us),
+
+	TP_STRUCT__entry(
+		__field(int, bus_num)
+		__field(int, chip_select)
+		__field(u8, milestone)
+		__field(u64, since_probe_us)
+		__field(u64, delta_us)
+	),
+
+	TP_fast_assign(
+		__entry->bus_num = shid->spi->controller->bus_num;
+		__entry->chip_select = shid->spi->chip_select[0];
+		__entry->milestone = milestone;
+		__entry->since_probe_us = since_probe_us;
+		__entry->delta_us = delta_us;
+	),
+
+	TP_printk("spi%d.%d: milestone %u at %llu us (+%llu us)",
+		__entry->bus_num, __entry->chip_select, __entry->milestone,
+		__entry->since_probe_us, __entry->delta_us)
+);
+
+/*
+* End of the input pipeline, one event per report handed to the HID core.
+* See tools/spi-hid-hist.sh for hist-trigger recipes built on it.
+*/
+TRACE_EVENT(spi_hid_input_delivered,
+	TP_PROTO(struct spi_hid *shid, u8 report_id, u16 len, u64 irq_ns,
+			u64 delivered_ns, int ret),
+
+	TP_ARGS(shid, report_id, len, irq_ns, delivered_ns, ret),
+
+	TP_STRUCT__entry(
+		__field(int, bus_num)
+		__field(int, chip_select)
+		__field(u8, report_id)
+		__field(u16, len)
+		__field(u64, irq_ns)
+		__field(u64, delivered_ns)
+		__field(u64, latency_us)
+		__field(int, ret)
+	),
+
+	TP_fast_assign(
+		__entry->bus_num = shid->spi->controller->bus_num;
+		__entry->chip_select = shid->spi->chip_select[0];
+		__entry->report_id = report_id;
+		__entry->len = len;
+		__entry->irq_ns = irq_ns;
+		__entry->delivered_ns = delivered_ns;
+		__entry->latency_us = irq_ns && delivered_ns > irq_ns ?
+				div_u64(delivered_ns - irq_ns, NSEC_PER_USEC) : 0;
+		__entry->ret = ret;
+	),
+
+	TP_printk("spi%d.%d: id=0x%02x len=%u irq=%llu delivered=%llu latency=%llu us --> %d",
+		__entry->bus_num, __entry->chip_select, __entry->report_id,
+		__entry->len, __entry->irq_ns, __entry->delivered_ns,
+		__entry->latency_us, __entry->ret)
+);
+
+TRACE_EVENT(spi_hid_watchdog,
+	TP_PROTO(struct spi_hid *shid, u8 reason, u64 value),
+
+	TP_ARGS(shid, reason, value),
+
+	TP_STRUCT__entry(
+		__field(int, bus_num)
+		__field(int, chip_select)
+		__field(u8, reason)
+		__field(u64, value)
+	),
+
+	TP_fast_assign(
+		__entry->bus_num = shid->spi->controller->bus_num;
+		__entry->chip_select = shid->spi->chip_select[0];
+		__entry->reason = reason;
+		__entry->value = value;
+	),
+
+	TP_printk("spi%d.%d: %s %llu %s",
+		__entry->bus_num, __entry->chip_select,
+		__entry->reason ? "latency over SLO," : "no heartbeat for",
+		__entry->value, __entry->reason ? "us" : "ms")
+);
+
 #endif /* _SPI_HID_TRACE_H */
 
 #undef TRACE_INCLUDE_PATH
@@ -0,0 +1,813 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * spi-hid-analyze.c
+ *
+ * Rebuilds the input pipeline of every report from a text capture of the
+ * spi_hid trace events (tracefs trace/trace_pipe or trace-cmd report) and
+ * prints per-stage latency percentiles, frame intervals, jitter, gaps and
+ * bus utilization.
+ *
+ * Captures are streamed: a reader thread cuts the input into blocks at
+ * line boundaries, worker threads parse blocks into compact events, and
+ * the main thread replays the events in capture order. Only a fixed pool
+ * of blocks is ever in flight and all statistics are fixed-size log-linear
+ * histograms, so memory does not grow with the capture.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BLOCK_SIZE		(4 << 20)
+#define MAX_THREADS		64
+#define MAX_DEVICES		16
+#define IRQ_FIFO_LEN		16
+#define TOP_GAPS		5
+
+/* Log-linear histogram: exact below HIST_SUB, then HIST_SUB steps per power of two */
+#define HIST_SUB_BITS		6
+#define HIST_SUB		(1 << HIST_SUB_BITS)
+#define HIST_BUCKETS		(64 * HIST_SUB)
+
+enum ev_type {
+	EV_IRQ,
+	EV_ASYNC,
+	EV_HEADER_DONE,
+	EV_BODY_DONE,
+	EV_HANDLER,
+};
+
+/* Transfer events come as a payload event and its _hdr twin */
+enum ev_family {
+	EV_SINGLE,
+	EV_PAYLOAD,
+	EV_HDR,
+};
+
+static const struct {
+	const char *name;
+	enum ev_type type;
+	enum ev_family family;
+} ev_names[] = {
+	{ "spi_hid_dev_irq", EV_IRQ, EV_SINGLE },
+	{ "spi_hid_input_async", EV_ASYNC, EV_PAYLOAD },
+	{ "spi_hid_input_async_hdr", EV_ASYNC, EV_HDR },
+	{ "spi_hid_input_header_complete", EV_HEADER_DONE, EV_PAYLOAD },
+	{ "spi_hid_input_header_complete_hdr", EV_HEADER_DONE, EV_HDR },
+	{ "spi_hid_input_body_complete", EV_BODY_DONE, EV_PAYLOAD },
+	{ "spi_hid_input_body_complete_hdr", EV_BODY_DONE, EV_HDR },
+	{ "spi_hid_input_report_handler", EV_HANDLER, EV_SINGLE },
+};
+
+struct event {
+	uint64_t ts;		/* ns */
+	uint32_t len;		/* tx + rx bytes */
+	int32_t ret;
+	uint16_t bus;
+	uint16_t cs;
+	uint8_t type;
+	uint8_t family;
+};
+
+enum block_state {
+	BLOCK_FREE,
+	BLOCK_READ,
+	BLOCK_PARSING,
+	BLOCK_PARSED,
+};
+
+struct block {
+	enum block_state state;
+	long seq;
+	char *buf;
+	size_t len;
+	struct event *ev;
+	size_t nev;
+	size_t evcap;
+	unsigned long bad_lines;
+};
+
+struct hist {
+	uint64_t count;
+	uint64_t min;
+	uint64_t max;
+	double sum;
+	uint64_t b[HIST_BUCKETS];
+};
+
+enum stage {
+	ST_IRQ_TO_HEADER,
+	ST_HEADER,
+	ST_HEADER_TO_BODY,
+	ST_BODY,
+	ST_BODY_TO_HANDLER,
+	ST_TOTAL,
+	ST_FRAME_INTERVAL,
+	ST_JITTER,
+	ST_COUNT,
+};
+
+static const char *const stage_names[ST_COUNT] = {
+	[ST_IRQ_TO_HEADER] = "irq_to_header",
+	[ST_HEADER] = "header",
+	[ST_HEADER_TO_BODY] = "header_to_body",
+	[ST_BODY] = "body",
+	[ST_BODY_TO_HANDLER] = "body_to_handler",
+	[ST_TOTAL] = "total",
+	[ST_FRAME_INTERVAL] = "frame_interval",
+	[ST_JITTER] = "jitter",
+};
+
+enum pipe_state {
+	P_IDLE,
+	P_HEADER,	/* header read submitted */
+	P_HEADER_DONE,
+	P_BODY,		/* body read submitted */
+	P_BODY_DONE,
+	P_RESYNC,	/* failed transfer, the header is re-read for the same IRQ */
+};
+
+struct gap {
+	uint64_t ts;
+	uint64_t len;
+};
+
+struct device {
+	uint16_t bus;
+	uint16_t cs;
+
+	enum pipe_state state;
+	uint64_t irq_fifo[IRQ_FIFO_LEN];
+	unsigned int irq_head, irq_count;
+	uint64_t t_irq, t_submit, t_header, t_body;
+	bool hdr_seen;
+	uint64_t last_ts;
+
+	uint64_t first_ts, end_ts;
+	uint64_t busy_ns;
+	uint64_t bytes;
+	uint64_t irqs, irq_overflows, frames, errors, out_of_order;
+	uint64_t prev_frame_irq, prev_interval;
+	uint64_t gaps;
+	struct gap top_gaps[TOP_GAPS];
+
+	struct hist hist[ST_COUNT];
+};
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct block *blocks;
+	int nblocks;
+	long next_read;
+	long next_consume;
+	long total;		/* blocks read, valid once eof */
+	bool eof;
+	int read_error;
+} pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static FILE *input;
+static struct device devices[MAX_DEVICES];
+static int ndevices;
+static unsigned long bad_lines;
+static uint64_t gap_threshold_ns = 100000000;	/* 100 ms */
+static int filter_bus = -1, filter_cs = -1;
+
+static void hist_add(struct hist *h, uint64_t v)
+{
+	unsigned int idx;
+
+	if (v < HIST_SUB) {
+		idx = v;
+	} else {
+		int msb = 63 - __builtin_clzll(v);
+		int shift = msb - HIST_SUB_BITS;
+
+		idx = (shift + 1) * HIST_SUB + ((v >> shift) & (HIST_SUB - 1));
+	}
+
+	if (!h->count || v < h->min)
+		h->min = v;
+	if (v > h->max)
+		h->max = v;
+	h->count++;
+	h->sum += v;
+	h->b[idx]++;
+}
+
+/* Upper bound of bucket @idx, so tail percentiles are never understated */
+static uint64_t hist_bucket_max(unsigned int idx)
+{
+	unsigned int shift;
+
+	if (idx < HIST_SUB)
+		return idx;
+
+	shift = idx / HIST_SUB - 1;
+
+	return (((uint64_t)HIST_SUB + idx % HIST_SUB) << shift) +
+			((1ULL << shift) - 1);
+}
+
+static uint64_t hist_percentile(const struct hist *h, double p)
+{
+	uint64_t rank = (uint64_t)(h->count * p + 0.999999);
+	uint64_t seen = 0;
+	unsigned int i;
+
+	if (!rank)
+		rank = 1;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += h->b[i];
+		if (seen >= rank) {
+			uint64_t v = hist_bucket_max(i);
+
+			return v > h->max ? h->max : v;
+		}
+	}
+
+	return h->max;
+}
+
+/* Parses the "secs.frac" timestamp ending at @end into ns */
+static bool parse_ts(const char *line, const char *end, uint64_t *ts)
+{
+	const char *p = end;
+	uint64_t secs = 0, frac = 0;
+	int digits = 0;
+
+	while (p > line && (isdigit((unsigned char)p[-1]) || p[-1] == '.'))
+		p--;
+	if (p == end)
+		return false;
+
+	for (; p < end && *p != '.'; p++)
+		secs = secs * 10 + (*p - '0');
+	if (p < end && *p == '.')
+		for (p++; p < end; p++, digits++)
+			frac = frac * 10 + (*p - '0');
+	if (digits > 9)
+		return false;
+	for (; digits < 9; digits++)
+		frac *= 10;
+
+	*ts = secs * 1000000000ULL + frac;
+
+	return true;
+}
+
+static int parse_field(const char *s, const char *key, long *val)
+{
+	const char *p = strstr(s, key);
+	char *end;
+
+	if (!p)
+		return -1;
+	p += strlen(key);
+	if (!isdigit((unsigned char)*p) && *p != '-')
+		return -1;
+	*val = strtol(p, &end, 10);
+
+	return 0;
+}
+
+/* Returns 1 for a spi_hid event, 0 for other lines, -1 for a bad event line */
+static int parse_line(const char *line, struct event *ev)
+{
+	const char *p = strstr(line, ": spi_hid_");
+	const char *name, *name_end, *args;
+	unsigned int bus, cs;
+	long tx, rx, val;
+	size_t n, i;
+
+	if (!p)
+		return 0;
+
+	name = p + 2;
+	name_end = strchr(name, ':');
+	if (!name_end)
+		return -1;
+	n = name_end - name;
+
+	for (i = 0; i < sizeof(ev_names) / sizeof(ev_names[0]); i++)
+		if (strlen(ev_names[i].name) == n &&
+				!strncmp(ev_names[i].name, name, n))
+			break;
+	if (i == sizeof(ev_names) / sizeof(ev_names[0]))
+		return 0;
+
+	if (!parse_ts(line, p, &ev->ts))
+		return -1;
+
+	args = name_end + 1;
+	while (*args == ' ')
+		args++;
+	if (sscanf(args, "spi%u.%u:", &bus, &cs) != 2)
+		return -1;
+
+	ev->type = ev_names[i].type;
+	ev->family = ev_names[i].family;
+	ev->bus = bus;
+	ev->cs = cs;
+	ev->len = 0;
+	ev->ret = 0;
+
+	if (!parse_field(args, "len=", &val))
+		ev->len = val;
+	else if (!parse_field(args, "tx=", &tx) && !parse_field(args, "rx=", &rx))
+		ev->len = tx + rx;
+
+	p = strstr(args, "--> ");
+	if (p)
+		ev->ret = atoi(p + 4);
+
+	return 1;
+}
+
+static void parse_block(struct block *blk)
+{
+	char *line = blk->buf, *end = blk->buf + blk->len, *nl;
+	struct event ev;
+	int ret;
+
+	blk->nev = 0;
+	blk->bad_lines = 0;
+
+	for (; line < end; line = nl + 1) {
+		nl = memchr(line, '\n', end - line);
+		if (!nl)
+			nl = end;
+		*nl = '\0';
+
+		ret = parse_line(line, &ev);
+		if (ret < 0)
+			blk->bad_lines++;
+		if (ret <= 0)
+			continue;
+
+		if (blk->nev == blk->evcap) {
+			size_t cap = blk->evcap ? blk->evcap * 2 : 4096;
+			struct event *e = realloc(blk->ev, cap * sizeof(*e));
+
+			if (!e) {
+				blk->bad_lines++;
+				continue;
+			}
+			blk->ev = e;
+			blk->evcap = cap;
+		}
+		blk->ev[blk->nev++] = ev;
+	}
+}
+
+static void *reader_thread(void *arg)
+{
+	static char carry[BLOCK_SIZE];
+	size_t carry_len = 0;
+	struct block *blk;
+	size_t n, cut;
+	int i;
+
+	for (;;) {
+		pthread_mutex_lock(&pool.lock);
+		for (;;) {
+			for (i = 0; i < pool.nblocks; i++)
+				if (pool.blocks[i].state == BLOCK_FREE)
+					break;
+			if (i < pool.nblocks)
+				break;
+			pthread_cond_wait(&pool.cond, &pool.lock);
+		}
+		blk = &pool.blocks[i];
+		pthread_mutex_unlock(&pool.lock);
+
+		memcpy(blk->buf, carry, carry_len);
+		n = fread(blk->buf + carry_len, 1, BLOCK_SIZE - carry_len, input);
+		blk->len = carry_len + n;
+		carry_len = 0;
+
+		if (!blk->len) {
+			pthread_mutex_lock(&pool.lock);
+			pool.read_error = ferror(input) ? EIO : 0;
+			pool.total = pool.next_read;
+			pool.eof = true;
+			pthread_cond_broadcast(&pool.cond);
+			pthread_mutex_unlock(&pool.lock);
+			return NULL;
+		}
+
+		/* Cut at the last full line, a line longer than a block is split */
+		if (n && blk->len == BLOCK_SIZE) {
+			for (cut = blk->len; cut > 0 && blk->buf[cut - 1] != '\n'; cut--)
+				;
+			if (cut) {
+				carry_len = blk->len - cut;
+				memcpy(carry, blk->buf + cut, carry_len);
+				blk->len = cut;
+			}
+		}
+
+		pthread_mutex_lock(&pool.lock);
+		blk->seq = pool.next_read++;
+		blk->state = BLOCK_READ;
+		pthread_cond_broadcast(&pool.cond);
+		pthread_mutex_unlock(&pool.lock);
+	}
+}
+
+static void *parser_thread(void *arg)
+{
+	struct block *blk;
+	int i;
+
+	for (;;) {
+		pthread_mutex_lock(&pool.lock);
+		for (;;) {
+			for (i = 0; i < pool.nblocks; i++)
+				if (pool.blocks[i].state == BLOCK_READ)
+					break;
+			if (i < pool.nblocks || pool.eof)
+				break;
+			pthread_cond_wait(&pool.cond, &pool.lock);
+		}
+		if (i == pool.nblocks) {
+			pthread_mutex_unlock(&pool.lock);
+			return NULL;
+		}
+		blk = &pool.blocks[i];
+		blk->state = BLOCK_PARSING;
+		pthread_mutex_unlock(&pool.lock);
+
+		parse_block(blk);
+
+		pthread_mutex_lock(&pool.lock);
+		blk->state = BLOCK_PARSED;
+		pthread_cond_broadcast(&pool.cond);
+		pthread_mutex_unlock(&pool.lock);
+	}
+}
+
+static struct device *get_device(uint16_t bus, uint16_t cs)
+{
+	struct device *d;
+	int i;
+
+	for (i = 0; i < ndevices; i++)
+		if (devices[i].bus == bus && devices[i].cs == cs)
+			return &devices[i];
+
+	if (ndevices == MAX_DEVICES)
+		return NULL;
+
+	d = &devices[ndevices++];
+	memset(d, 0, sizeof(*d));
+	d->bus = bus;
+	d->cs = cs;
+
+	return d;
+}
+
+static void record_gap(struct device *d, uint64_t ts, uint64_t len)
+{
+	int i, j;
+
+	d->gaps++;
+	for (i = 0; i < TOP_GAPS; i++)
+		if (len > d->top_gaps[i].len)
+			break;
+	if (i == TOP_GAPS)
+		return;
+
+	for (j = TOP_GAPS - 1; j > i; j--)
+		d->top_gaps[j] = d->top_gaps[j - 1];
+	d->top_gaps[i].ts = ts;
+	d->top_gaps[i].len = len;
+}
+
+static void frame_done(struct device *d)
+{
+	uint64_t interval, jitter;
+
+	d->frames++;
+	if (!d->t_irq)
+		return;
+
+	if (d->prev_frame_irq && d->t_irq > d->prev_frame_irq) {
+		interval = d->t_irq - d->prev_frame_irq;
+		hist_add(&d->hist[ST_FRAME_INTERVAL], interval);
+		if (interval >= gap_threshold_ns)
+			record_gap(d, d->prev_frame_irq, interval);
+
+		if (d->prev_interval) {
+			jitter = interval > d->prev_interval ?
+				interval - d->prev_interval :
+				d->prev_interval - interval;
+			hist_add(&d->hist[ST_JITTER], jitter);
+		}
+		d->prev_interval = interval;
+	}
+	d->prev_frame_irq = d->t_irq;
+}
+
+static void stage_add(struct device *d, enum stage st, uint64_t from,
+		uint64_t to)
+{
+	if (from && to >= from)
+		hist_add(&d->hist[st], to - from);
+}
+
+static void replay_event(const struct event *ev)
+{
+	struct device *d;
+
+	if ((filter_bus >= 0 && ev->bus != filter_bus) ||
+			(filter_cs >= 0 && ev->cs != filter_cs))
+		return;
+
+	d = get_device(ev->bus, ev->cs);
+	if (!d)
+		return;
+
+	/*
+	* With payload sampling on, every transfer shows up as a _hdr event and
+	* its payload twin, not necessarily with the same timestamp. Once a
+	* _hdr event has been seen only that family is used.
+	*/
+	if (ev->family == EV_HDR)
+		d->hdr_seen = true;
+	else if (ev->family == EV_PAYLOAD && d->hdr_seen)
+		return;
+	if (ev->ts < d->last_ts)
+		d->out_of_order++;
+	d->last_ts = ev->ts;
+
+	if (!d->first_ts)
+		d->first_ts = ev->ts;
+	d->end_ts = ev->ts;
+
+	switch (ev->type) {
+	case EV_IRQ:
+		d->irqs++;
+		if (d->irq_count == IRQ_FIFO_LEN) {
+			d->irq_head = (d->irq_head + 1) % IRQ_FIFO_LEN;
+			d->irq_count--;
+			d->irq_overflows++;
+		}
+		d->irq_fifo[(d->irq_head + d->irq_count++) % IRQ_FIFO_LEN] =
+				ev->ts;
+		break;
+
+	case EV_ASYNC:
+		d->bytes += ev->len;
+		if (d->state == P_HEADER_DONE) {
+			stage_add(d, ST_HEADER_TO_BODY, d->t_header, ev->ts);
+			d->state = P_BODY;
+		} else {
+			/* A new frame takes the oldest IRQ, a re-read keeps its own */
+			if (d->state != P_RESYNC) {
+				d->t_irq = 0;
+				if (d->irq_count) {
+					d->t_irq = d->irq_fifo[d->irq_head];
+					d->irq_head = (d->irq_head + 1) %
+							IRQ_FIFO_LEN;
+					d->irq_count--;
+				}
+				stage_add(d, ST_IRQ_TO_HEADER, d->t_irq, ev->ts);
+			}
+			d->state = P_HEADER;
+		}
+		d->t_submit = ev->ts;
+		break;
+
+	case EV_HEADER_DONE:
+		if (d->state != P_HEADER)
+			break;
+		d->busy_ns += ev->ts - d->t_submit;
+		if (ev->ret < 0) {
+			d->errors++;
+			d->state = P_RESYNC;
+			break;
+		}
+		stage_add(d, ST_HEADER, d->t_submit, ev->ts);
+		d->t_header = ev->ts;
+		d->state = P_HEADER_DONE;
+		break;
+
+	case EV_BODY_DONE:
+		if (d->state != P_BODY)
+			break;
+		d->busy_ns += ev->ts - d->t_submit;
+		if (ev->ret < 0) {
+			d->errors++;
+			d->state = P_RESYNC;
+			break;
+		}
+		stage_add(d, ST_BODY, d->t_submit, ev->ts);
+		d->t_body = ev->ts;
+		d->state = P_BODY_DONE;
+		frame_done(d);
+		break;
+
+	case EV_HANDLER:
+		/* Only data reports reach the handler */
+		if (d->state != P_BODY_DONE)
+			break;
+		stage_add(d, ST_BODY_TO_HANDLER, d->t_body, ev->ts);
+		stage_add(d, ST_TOTAL, d->t_irq, ev->ts);
+		d->state = P_IDLE;
+		break;
+	}
+}
+
+static void consume(void)
+{
+	struct block *blk;
+	size_t i;
+	int b;
+
+	for (;;) {
+		pthread_mutex_lock(&pool.lock);
+		for (;;) {
+			for (b = 0; b < pool.nblocks; b++)
+				if (pool.blocks[b].state == BLOCK_PARSED &&
+					pool.blocks[b].seq == pool.next_consume)
+					break;
+			if (b < pool.nblocks ||
+				(pool.eof && pool.next_consume == pool.total))
+				break;
+			pthread_cond_wait(&pool.cond, &pool.lock);
+		}
+		if (b == pool.nblocks) {
+			pthread_mutex_unlock(&pool.lock);
+			return;
+		}
+		blk = &pool.blocks[b];
+		pthread_mutex_unlock(&pool.lock);
+
+		for (i = 0; i < blk->nev; i++)
+			replay_event(&blk->ev[i]);
+		bad_lines += blk->bad_lines;
+
+		pthread_mutex_lock(&pool.lock);
+		blk->state = BLOCK_FREE;
+		pool.next_consume++;
+		pthread_cond_broadcast(&pool.cond);
+		pthread_mutex_unlock(&pool.lock);
+	}
+}
+
+static void print_device(const struct device *d)
+{
+	double secs = (d->end_ts - d->first_ts) / 1e9;
+	const struct hist *h;
+	int i;
+
+	printf("spi%u.%u: %.3f s, %llu IRQs, %llu frames, %llu transfer errors\n",
+			d->bus, d->cs, secs, (unsigned long long)d->irqs,
+			(unsigned long long)d->frames,
+			(unsigned long long)d->errors);
+
+	printf("%-16s %10s %10s %10s %10s %10s %10s %10s\n", "stage (us)",
+			"count", "min", "mean", "p50", "p99", "p999", "max");
+	for (i = 0; i < ST_COUNT; i++) {
+		h = &d->hist[i];
+		if (!h->count) {
+			printf("%-16s %10d\n", stage_names[i], 0);
+			continue;
+		}
+		printf("%-16s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+				stage_names[i], (unsigned long long)h->count,
+				h->min / 1e3, h->sum / h->count / 1e3,
+				hist_percentile(h, 0.50) / 1e3,
+				hist_percentile(h, 0.99) / 1e3,
+				hist_percentile(h, 0.999) / 1e3,
+				h->max / 1e3);
+	}
+
+	if (secs > 0)
+		printf("bus: busy %.2f%%, %llu bytes, %.1f KiB/s\n",
+				100.0 * d->busy_ns / (d->end_ts - d->first_ts),
+				(unsigned long long)d->bytes,
+				d->bytes / secs / 1024);
+
+	printf("gaps >= %llu ms: %llu\n",
+			(unsigned long long)(gap_threshold_ns / 1000000),
+			(unsigned long long)d->gaps);
+	for (i = 0; i < TOP_GAPS && d->top_gaps[i].len; i++)
+		printf("  %.6f: %.3f ms\n", d->top_gaps[i].ts / 1e9,
+				d->top_gaps[i].len / 1e6);
+
+	if (d->irq_overflows || d->out_of_order)
+		printf("warning: %llu unmatched IRQs dropped, %llu out of order events\n",
+				(unsigned long long)d->irq_overflows,
+				(unsigned long long)d->out_of_order);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-j threads] [-d bus.cs] [-g gap_ms] [capture|-]\n"
+		"\n"
+		"Reads tracefs or trace-cmd report output of the spi_hid events\n"
+		"and prints per-stage latency, frame interval, jitter, gap and\n"
+		"bus utilization statistics for every device.\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	pthread_t reader, parsers[MAX_THREADS];
+	long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned int bus, cs;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "j:d:g:h")) != -1) {
+		switch (opt) {
+		case 'j':
+			nthreads = atol(optarg);
+			break;
+		case 'd':
+			if (sscanf(optarg, "%u.%u", &bus, &cs) != 2) {
+				usage(argv[0]);
+				return 1;
+			}
+			filter_bus = bus;
+			filter_cs = cs;
+			break;
+		case 'g':
+			gap_threshold_ns = strtoull(optarg, NULL, 10) * 1000000ULL;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (nthreads < 1)
+		nthreads = 1;
+	if (nthreads > MAX_THREADS)
+		nthreads = MAX_THREADS;
+
+	if (optind < argc && strcmp(argv[optind], "-")) {
+		input = fopen(argv[optind], "r");
+		if (!input) {
+			perror(argv[optind]);
+			return 1;
+		}
+	} else {
+		input = stdin;
+	}
+
+	/* Enough blocks to keep every parser busy while the oldest is replayed */
+	pool.nblocks = nthreads * 2 + 2;
+	pool.blocks = calloc(pool.nblocks, sizeof(*pool.blocks));
+	if (!pool.blocks)
+		return 1;
+	for (i = 0; i < pool.nblocks; i++) {
+		pool.blocks[i].buf = malloc(BLOCK_SIZE);
+		if (!pool.blocks[i].buf)
+			return 1;
+	}
+
+	pthread_create(&reader, NULL, reader_thread, NULL);
+	for (i = 0; i < nthreads; i++)
+		pthread_create(&parsers[i], NULL, parser_thread, NULL);
+
+	consume();
+
+	pthread_join(reader, NULL);
+	for (i = 0; i < nthreads; i++)
+		pthread_join(parsers[i], NULL);
+
+	if (pool.read_error)
+		fprintf(stderr, "read error: %s\n", strerror(pool.read_error));
+	if (bad_lines)
+		fprintf(stderr, "%lu unparsable spi_hid lines skipped\n",
+				bad_lines);
+	if (!ndevices)
+		fprintf(stderr, "no spi_hid input events found\n");
+
+	for (i = 0; i < ndevices; i++) {
+		if (i)
+			printf("\n");
+		print_device(&devices[i]);
+	}
+
+	for (i = 0; i < pool.nblocks; i++) {
+		free(pool.blocks[i].buf);
+		free(pool.blocks[i].ev);
+	}
+	free(pool.blocks);
+
+	return pool.read_error ? 1 : 0;
+}
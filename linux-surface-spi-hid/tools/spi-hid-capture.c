@@ -0,0 +1,248 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * spi-hid-capture.c
+ *
+ * Inspects, merges and replays spi_hid binary captures.
+ *
+ *   echo 1 > /sys/kernel/debug/spi_hid/<dev>/capture_enable
+ *   ...
+ *   echo 0 > /sys/kernel/debug/spi_hid/<dev>/capture_enable
+ *   spi-hid-capture merge -o session.cap /sys/kernel/debug/spi_hid/<dev>/capture*
+ *   spi-hid-capture replay -s 0 -d <dev> session.cap
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "spi-hid-replay.h"
+
+#define DEBUGFS_DIR		"/sys/kernel/debug/spi_hid"
+
+static const char *const type_names[] = {
+	[SPI_HID_CAP_START] = "start",
+	[SPI_HID_CAP_INPUT] = "input",
+	[SPI_HID_CAP_OUTPUT] = "output",
+};
+
+static const char *type_name(unsigned int type)
+{
+	if (type < sizeof(type_names) / sizeof(type_names[0]))
+		return type_names[type];
+
+	return "unknown";
+}
+
+static int dump_rec(const struct spi_hid_cap_rec *rec, void *priv)
+{
+	const struct spi_hid_cap_start *start;
+	unsigned int max = *(unsigned int *)priv;
+	unsigned int i;
+
+	printf("%llu.%09llu %6llu %-6s len %5u",
+			(unsigned long long)(rec->ts_ns / 1000000000ULL),
+			(unsigned long long)(rec->ts_ns % 1000000000ULL),
+			(unsigned long long)rec->seq, type_name(rec->type),
+			rec->len);
+
+	if (rec->type == SPI_HID_CAP_START && rec->len >= sizeof(*start)) {
+		start = (const struct spi_hid_cap_start *)rec->data;
+		printf(" %04x:%04x v%u HID v%u.%u max in %u out %u\n",
+				start->vendor_id, start->product_id,
+				start->version_id, start->hid_version >> 8,
+				start->hid_version & 0xff,
+				start->max_input_length,
+				start->max_output_length);
+		return 0;
+	}
+
+	if (rec->type == SPI_HID_CAP_INPUT)
+		printf(" type 0x%02x id 0x%02x", spi_hid_cap_report_type(rec),
+				spi_hid_cap_report_id(rec));
+
+	printf(" :");
+	for (i = 0; i < rec->len && i < max; i++)
+		printf("%s%02x", i == rec->hdr_len ? " | " : " ", rec->data[i]);
+	printf("%s\n", rec->len > max ? " ..." : "");
+
+	return 0;
+}
+
+static int cmd_info(const struct spi_hid_capture *cap)
+{
+	unsigned long long by_type[3] = { 0 }, by_id[256] = { 0 };
+	unsigned long long bytes = 0;
+	const struct spi_hid_cap_rec *rec;
+	double secs = 0;
+	size_t i;
+
+	for (i = 0; i < cap->count; i++) {
+		rec = cap->recs[i];
+		if (rec->type < 3)
+			by_type[rec->type]++;
+		if (rec->type == SPI_HID_CAP_INPUT &&
+				spi_hid_cap_report_type(rec) == 0x01)
+			by_id[spi_hid_cap_report_id(rec)]++;
+		bytes += rec->len;
+	}
+
+	if (cap->count > 1)
+		secs = (cap->recs[cap->count - 1]->ts_ns - cap->recs[0]->ts_ns) /
+				1e9;
+
+	printf("%zu records, %.3f s, %llu payload bytes, %zu bytes skipped\n",
+			cap->count, secs, bytes, cap->skipped);
+	printf("starts %llu inputs %llu outputs %llu\n",
+			by_type[SPI_HID_CAP_START], by_type[SPI_HID_CAP_INPUT],
+			by_type[SPI_HID_CAP_OUTPUT]);
+	for (i = 0; i < 256; i++)
+		if (by_id[i])
+			printf("  id 0x%02zx %llu\n", i, by_id[i]);
+
+	return 0;
+}
+
+static int cmd_merge(const struct spi_hid_capture *cap, const char *path)
+{
+	FILE *out;
+	int ret;
+
+	out = fopen(path, "w");
+	if (!out) {
+		perror(path);
+		return 1;
+	}
+
+	ret = spi_hid_capture_write(cap, out);
+	fclose(out);
+	if (ret) {
+		fprintf(stderr, "%s: %s\n", path, strerror(-ret));
+		return 1;
+	}
+
+	return 0;
+}
+
+static int cmd_replay(const struct spi_hid_capture *cap, double speed,
+		const char *target)
+{
+	struct timespec start, end;
+	size_t i, inputs = 0;
+	double secs;
+	int fd, ret;
+
+	fd = open(target, O_WRONLY);
+	if (fd < 0) {
+		perror(target);
+		return 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ret = spi_hid_replay(cap, speed, 1U << SPI_HID_CAP_INPUT,
+			spi_hid_replay_to_fd, &fd);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	close(fd);
+
+	if (ret) {
+		fprintf(stderr, "replay stopped: %s\n", strerror(-ret));
+		return 1;
+	}
+
+	for (i = 0; i < cap->count; i++)
+		inputs += cap->recs[i]->type == SPI_HID_CAP_INPUT;
+
+	secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("replayed %zu inputs in %.3f s\n", inputs, secs);
+
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s info capture...\n"
+		"       %s dump [-b bytes] capture...\n"
+		"       %s merge -o out.cap capture...\n"
+		"       %s replay [-s speed] (-d device | -o file) capture...\n"
+		"\n"
+		"Several files, such as the per-CPU capture0..N relay files, are\n"
+		"merged in capture order. replay feeds the inputs to the driver's\n"
+		"debugfs replay file, -s 0 replays as fast as the driver takes\n"
+		"them, the default of 1 keeps the original pace.\n",
+		prog, prog, prog, prog);
+}
+
+int main(int argc, char **argv)
+{
+	const char *cmd, *out = NULL, *device = NULL;
+	struct spi_hid_capture cap;
+	unsigned int max = 32;
+	char target[256];
+	double speed = 1;
+	int opt, ret;
+
+	if (argc < 2) {
+		usage(argv[0]);
+		return 1;
+	}
+	cmd = argv[1];
+	optind = 2;
+
+	while ((opt = getopt(argc, argv, "o:d:s:b:h")) != -1) {
+		switch (opt) {
+		case 'o':
+			out = optarg;
+			break;
+		case 'd':
+			device = optarg;
+			break;
+		case 's':
+			speed = strtod(optarg, NULL);
+			break;
+		case 'b':
+			max = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (optind == argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	ret = spi_hid_capture_open(&cap, argv + optind, argc - optind);
+	if (ret) {
+		fprintf(stderr, "cannot read capture: %s\n", strerror(-ret));
+		return 1;
+	}
+
+	if (!strcmp(cmd, "info")) {
+		ret = cmd_info(&cap);
+	} else if (!strcmp(cmd, "dump")) {
+		ret = spi_hid_replay(&cap, 0, ~0U, dump_rec, &max);
+	} else if (!strcmp(cmd, "merge") && out) {
+		ret = cmd_merge(&cap, out);
+	} else if (!strcmp(cmd, "replay") && (out || device)) {
+		if (!out) {
+			snprintf(target, sizeof(target), "%s/%s/replay",
+					DEBUGFS_DIR, device);
+			out = target;
+		}
+		ret = cmd_replay(&cap, speed, out);
+	} else {
+		usage(argv[0]);
+		ret = 1;
+	}
+
+	spi_hid_capture_close(&cap);
+
+	return ret;
+}
@@ -0,0 +1,135 @@
+#!/bin/bash
+# Hist-trigger recipes for the spi_hid_input_delivered tracepoint
+#
+# Builds live in-kernel latency histograms, keyed by report ID, from the
+# end-of-pipeline event the driver emits for every report handed to the
+# HID core. Nothing is exported from the trace buffer, the histograms are
+# read straight from tracefs.
+#
+# Usage: spi-hid-hist.sh <enable|disable|show> <recipe>
+#        spi-hid-hist.sh pct
+#        spi-hid-hist.sh list
+#
+# Recipes:
+#   latency  IRQ-to-delivery latency in log2 microsecond buckets per report ID
+#   bytes    reports and payload bytes per report ID
+#   synth    spi_hid_irq_latency synthetic event, IRQ-to-delivery measured
+#            by the tracer itself from spi_hid_dev_irq, as a cross-check
+#
+# pct prints p50/p99/p999 per report ID from the latency histogram.
+
+TRACEFS=${TRACEFS:-/sys/kernel/tracing}
+[ -d "$TRACEFS/events" ] || TRACEFS=/sys/kernel/debug/tracing
+
+EVENTS=$TRACEFS/events/spi_hid
+DELIVERED=$EVENTS/spi_hid_input_delivered
+DEV_IRQ=$EVENTS/spi_hid_dev_irq
+SYNTH=$TRACEFS/events/synthetic/spi_hid_irq_latency
+
+LATENCY_HIST='hist:keys=report_id.hex,latency_us.log2:vals=hitcount:sort=report_id,latency_us:size=4096'
+BYTES_HIST='hist:keys=report_id.hex:vals=hitcount,len:sort=report_id'
+SYNTH_DEF='spi_hid_irq_latency int bus_num; u64 lat_us'
+SYNTH_START='hist:keys=bus_num:ts0=common_timestamp.usecs'
+SYNTH_MATCH='hist:keys=bus_num:lat_us=common_timestamp.usecs-$ts0:onmatch(spi_hid.spi_hid_dev_irq).trace(spi_hid_irq_latency,bus_num,$lat_us)'
+SYNTH_HIST='hist:keys=lat_us.log2:vals=hitcount:sort=lat_us'
+
+die() {
+	echo "spi-hid-hist: $*" >&2
+	exit 1
+}
+
+[ -d "$DELIVERED" ] || die "no spi_hid_input_delivered event in $EVENTS (module loaded?)"
+
+enable() {
+	case "$1" in
+	latency)
+		echo "$LATENCY_HIST" >> "$DELIVERED/trigger" ;;
+	bytes)
+		echo "$BYTES_HIST" >> "$DELIVERED/trigger" ;;
+	synth)
+		echo "$SYNTH_DEF" >> "$TRACEFS/synthetic_events" &&
+		echo "$SYNTH_START" >> "$DEV_IRQ/trigger" &&
+		echo "$SYNTH_MATCH" >> "$DELIVERED/trigger" &&
+		echo "$SYNTH_HIST" >> "$SYNTH/trigger" ;;
+	*)
+		die "unknown recipe '$1'" ;;
+	esac
+}
+
+# Triggers are removed in the reverse order of enable
+disable() {
+	case "$1" in
+	latency)
+		echo "!$LATENCY_HIST" >> "$DELIVERED/trigger" ;;
+	bytes)
+		echo "!$BYTES_HIST" >> "$DELIVERED/trigger" ;;
+	synth)
+		echo "!$SYNTH_HIST" >> "$SYNTH/trigger"
+		echo "!$SYNTH_MATCH" >> "$DELIVERED/trigger"
+		echo "!$SYNTH_START" >> "$DEV_IRQ/trigger"
+		echo "!$SYNTH_DEF" >> "$TRACEFS/synthetic_events" ;;
+	*)
+		die "unknown recipe '$1'" ;;
+	esac
+}
+
+show() {
+	case "$1" in
+	latency|bytes)
+		cat "$DELIVERED/hist" ;;
+	synth)
+		cat "$SYNTH/hist" ;;
+	*)
+		die "unknown recipe '$1'" ;;
+	esac
+}
+
+# Percentiles are reported as the upper bound of the log2 bucket
+pct() {
+	awk '
+	/report_id:/ && /latency_us:/ {
+		match($0, /report_id: *[0-9a-fx]+/)
+		id = substr($0, RSTART, RLENGTH); sub(/report_id: */, "", id)
+		match($0, /2\^[0-9]+/)
+		bucket = substr($0, RSTART + 2, RLENGTH - 2) + 0
+		match($0, /hitcount: *[0-9]+/)
+		cnt = substr($0, RSTART, RLENGTH); sub(/hitcount: */, "", cnt)
+		ids[id] = 1
+		hist[id, bucket] += cnt
+		total[id] += cnt
+		if (bucket > maxbucket)
+			maxbucket = bucket
+	}
+	END {
+		printf "%-10s %12s %10s %10s %10s\n", "report_id", "count",
+				"p50_us", "p99_us", "p999_us"
+		for (id in ids) {
+			n = split("500 990 999", pm, " ")
+			for (i = 1; i <= n; i++) {
+				rank = total[id] * pm[i] / 1000
+				seen = 0
+				for (e = 0; e <= maxbucket; e++) {
+					seen += hist[id, e]
+					if (seen >= rank)
+						break
+				}
+				p[i] = 2 ^ e
+			}
+			printf "%-10s %12d %10d %10d %10d\n", id, total[id],
+					p[1], p[2], p[3]
+		}
+	}' "$DELIVERED/hist"
+}
+
+case "$1" in
+enable|disable|show)
+	[ -n "$2" ] || die "usage: $0 $1 <latency|bytes|synth>"
+	"$1" "$2" ;;
+pct)
+	pct ;;
+list)
+	echo "latency bytes synth" ;;
+*)
+	sed -n '2,20s/^# \{0,1\}//p' "$0"
+	exit 1 ;;
+esac
@@ -0,0 +1,258 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * spi-hid-replay.c
+ *
+ * Capture reader and replay pacing for spi_hid binary captures.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "spi-hid-replay.h"
+
+#define REPLAY_BUSY_RETRIES	1000
+#define REPLAY_BUSY_WAIT_NS	100000
+
+static int rec_valid(const struct spi_hid_cap_rec *rec, size_t avail)
+{
+	return rec->magic == SPI_HID_CAP_MAGIC &&
+			rec->version == SPI_HID_CAP_VERSION &&
+			rec->size <= avail &&
+			!(rec->size & (SPI_HID_CAP_ALIGN - 1)) &&
+			rec->hdr_len <= rec->len &&
+			rec->size >= SPI_HID_CAP_REC_SIZE(rec->len);
+}
+
+static int rec_cmp(const void *a, const void *b)
+{
+	const struct spi_hid_cap_rec *ra = *(const struct spi_hid_cap_rec **)a;
+	const struct spi_hid_cap_rec *rb = *(const struct spi_hid_cap_rec **)b;
+
+	/* seq restarts with every capture, the timestamp orders sessions */
+	if (ra->ts_ns != rb->ts_ns)
+		return ra->ts_ns < rb->ts_ns ? -1 : 1;
+	if (ra->seq != rb->seq)
+		return ra->seq < rb->seq ? -1 : 1;
+
+	return 0;
+}
+
+/* For files without a size, such as the live relay files in debugfs */
+static void *read_all(int fd, size_t *len)
+{
+	size_t size = 1 << 20, used = 0;
+	char *buf = NULL, *tmp;
+	ssize_t n;
+
+	for (;;) {
+		tmp = realloc(buf, size);
+		if (!tmp)
+			break;
+		buf = tmp;
+
+		n = read(fd, buf + used, size - used);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			break;
+		if (!n) {
+			*len = used;
+			return buf;
+		}
+		used += n;
+		if (used == size)
+			size *= 2;
+	}
+
+	free(buf);
+
+	return NULL;
+}
+
+static int index_map(struct spi_hid_capture *cap, const uint8_t *p,
+		size_t len, size_t *cap_recs)
+{
+	const struct spi_hid_cap_rec **recs;
+	const struct spi_hid_cap_rec *rec;
+	size_t pos = 0;
+
+	while (len - pos >= sizeof(*rec)) {
+		rec = (const struct spi_hid_cap_rec *)(p + pos);
+		if (!rec_valid(rec, len - pos)) {
+			pos += SPI_HID_CAP_ALIGN;
+			cap->skipped += SPI_HID_CAP_ALIGN;
+			continue;
+		}
+
+		if (cap->count == *cap_recs) {
+			*cap_recs = *cap_recs ? *cap_recs * 2 : 4096;
+			recs = realloc(cap->recs, *cap_recs * sizeof(*recs));
+			if (!recs)
+				return -ENOMEM;
+			cap->recs = recs;
+		}
+		cap->recs[cap->count++] = rec;
+		pos += rec->size;
+	}
+
+	cap->skipped += len - pos;
+
+	return 0;
+}
+
+int spi_hid_capture_open(struct spi_hid_capture *cap,
+		char *const *paths, int npaths)
+{
+	size_t cap_recs = 0, len;
+	struct stat st;
+	void *addr;
+	int fd, i, ret;
+
+	memset(cap, 0, sizeof(*cap));
+
+	if (npaths > SPI_HID_CAPTURE_MAX_FILES)
+		return -E2BIG;
+
+	for (i = 0; i < npaths; i++) {
+		fd = open(paths[i], O_RDONLY);
+		if (fd < 0) {
+			ret = -errno;
+			goto err;
+		}
+		if (fstat(fd, &st)) {
+			ret = -errno;
+			close(fd);
+			goto err;
+		}
+		if (S_ISREG(st.st_mode) && st.st_size) {
+			len = st.st_size;
+			addr = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (addr == MAP_FAILED)
+				addr = NULL;
+			else
+				madvise(addr, len, MADV_SEQUENTIAL);
+			cap->maps[cap->nmaps].mapped = 1;
+		} else {
+			addr = read_all(fd, &len);
+			cap->maps[cap->nmaps].mapped = 0;
+		}
+		ret = -errno;
+		close(fd);
+		if (!addr)
+			goto err;
+
+		cap->maps[cap->nmaps].addr = addr;
+		cap->maps[cap->nmaps].len = len;
+		cap->nmaps++;
+
+		ret = index_map(cap, addr, len, &cap_recs);
+		if (ret)
+			goto err;
+	}
+
+	qsort(cap->recs, cap->count, sizeof(*cap->recs), rec_cmp);
+
+	return 0;
+
+err:
+	spi_hid_capture_close(cap);
+
+	return ret;
+}
+
+void spi_hid_capture_close(struct spi_hid_capture *cap)
+{
+	int i;
+
+	for (i = 0; i < cap->nmaps; i++) {
+		if (cap->maps[i].mapped)
+			munmap(cap->maps[i].addr, cap->maps[i].len);
+		else
+			free(cap->maps[i].addr);
+	}
+	free(cap->recs);
+	memset(cap, 0, sizeof(*cap));
+}
+
+int spi_hid_capture_write(const struct spi_hid_capture *cap, FILE *out)
+{
+	size_t i;
+
+	for (i = 0; i < cap->count; i++)
+		if (fwrite(cap->recs[i], cap->recs[i]->size, 1, out) != 1)
+			return -EIO;
+
+	return fflush(out) ? -errno : 0;
+}
+
+static void ts_add_ns(struct timespec *ts, uint64_t ns)
+{
+	ns += ts->tv_nsec;
+	ts->tv_sec += ns / 1000000000ULL;
+	ts->tv_nsec = ns % 1000000000ULL;
+}
+
+int spi_hid_replay(const struct spi_hid_capture *cap, double speed,
+		unsigned int types, spi_hid_replay_fn fn, void *priv)
+{
+	const struct spi_hid_cap_rec *rec;
+	struct timespec start, due;
+	uint64_t first_ns = 0;
+	size_t i;
+	int ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < cap->count; i++) {
+		rec = cap->recs[i];
+		if (rec->type >= 32 || !(types & (1U << rec->type)))
+			continue;
+
+		if (!first_ns)
+			first_ns = rec->ts_ns;
+
+		/* Due times are relative to the start, so delays do not add up */
+		if (speed > 0 && rec->ts_ns > first_ns) {
+			due = start;
+			ts_add_ns(&due, (uint64_t)((rec->ts_ns - first_ns) / speed));
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					&due, NULL) == EINTR)
+				;
+		}
+
+		ret = fn(rec, priv);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+int spi_hid_replay_to_fd(const struct spi_hid_cap_rec *rec, void *priv)
+{
+	struct timespec wait = { .tv_nsec = REPLAY_BUSY_WAIT_NS };
+	int fd = *(int *)priv;
+	int retries = 0;
+	ssize_t n;
+
+	/* The driver only takes an input between two live transfers */
+	for (;;) {
+		n = write(fd, rec, rec->size);
+		if (n == (ssize_t)rec->size)
+			return 0;
+		if (n >= 0)
+			return -EIO;
+		if (errno != EBUSY && errno != EINTR)
+			return -errno;
+		if (errno == EBUSY && ++retries > REPLAY_BUSY_RETRIES)
+			return -EBUSY;
+		nanosleep(&wait, NULL);
+	}
+}
@@ -0,0 +1,79 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * spi-hid-replay.h
+ *
+ * Reads spi_hid binary captures (see module/spi-hid-capture.h) and plays
+ * them back in capture order, at the original pace or as fast as the
+ * consumer takes them.
+ */
+
+#ifndef SPI_HID_REPLAY_H
+#define SPI_HID_REPLAY_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "../module/spi-hid-capture.h"
+
+#define SPI_HID_CAPTURE_MAX_FILES	64
+
+struct spi_hid_capture {
+	int nmaps;
+	struct {
+		void *addr;
+		size_t len;
+		int mapped;	/* else read into a heap buffer */
+	} maps[SPI_HID_CAPTURE_MAX_FILES];
+
+	/* Records of all files in capture order */
+	const struct spi_hid_cap_rec **recs;
+	size_t count;
+
+	/* Bytes stepped over between records, e.g. relay sub-buffer padding */
+	size_t skipped;
+};
+
+/* Called for every replayed record, a non-zero return stops the replay */
+typedef int (*spi_hid_replay_fn)(const struct spi_hid_cap_rec *rec,
+		void *priv);
+
+/*
+ * Maps @paths, for example the per-CPU capture files of one session or
+ * a merged capture, and orders their records. Returns 0 or -errno.
+ */
+int spi_hid_capture_open(struct spi_hid_capture *cap,
+		char *const *paths, int npaths);
+void spi_hid_capture_close(struct spi_hid_capture *cap);
+
+/* Writes the records in capture order as one capture file */
+int spi_hid_capture_write(const struct spi_hid_capture *cap, FILE *out);
+
+/*
+ * Hands records whose type bit is set in @types to @fn. @speed scales the
+ * original pacing, 2.0 plays twice as fast, 0 does not wait at all.
+ */
+int spi_hid_replay(const struct spi_hid_capture *cap, double speed,
+		unsigned int types, spi_hid_replay_fn fn, void *priv);
+
+/*
+ * Replay callback writing each record to the file descriptor in @priv
+ * (an int *), such as the driver's debugfs replay file.
+ */
+int spi_hid_replay_to_fd(const struct spi_hid_cap_rec *rec, void *priv);
+
+static inline unsigned int spi_hid_cap_report_type(
+		const struct spi_hid_cap_rec *rec)
+{
+	return rec->type == SPI_HID_CAP_INPUT && rec->len ?
+			(rec->data[0] >> 4) & 0xf : 0;
+}
+
+/* Content ID of an input body, 0 if the record has none */
+static inline unsigned int spi_hid_cap_report_id(
+		const struct spi_hid_cap_rec *rec)
+{
+	return rec->type == SPI_HID_CAP_INPUT && rec->len > rec->hdr_len + 2U ?
+			rec->data[rec->hdr_len + 2] : 0;
+}
+
+#endif
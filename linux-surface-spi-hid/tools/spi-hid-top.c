@@ -0,0 +1,606 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * spi-hid-top.c
+ *
+ * Live health view of the spi_hid devices. Every interval it reads the
+ * driver's sysfs attributes and, when debugfs is readable, the stats and
+ * latency_hist files, then shows report and byte rates per report ID,
+ * latency percentiles over the last interval, power state, errors and
+ * reset events. Optionally appends one CSV row per device and interval.
+ *
+ * Each poll is a handful of small reads into static buffers, nothing is
+ * allocated after startup.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef DRIVER_DIR
+#define DRIVER_DIR		"/sys/bus/spi/drivers/spi_hid"
+#endif
+#ifndef DEBUGFS_DIR
+#define DEBUGFS_DIR		"/sys/kernel/debug/spi_hid"
+#endif
+
+#define MAX_DEVICES		8
+#define MAX_EVENTS		8
+#define TOP_IDS			8
+#define LAT_BUCKETS		64
+
+enum {
+	LAT_HEADER,
+	LAT_BODY,
+	LAT_TOTAL,
+	LAT_STAGES,
+};
+
+static const char *const lat_names[LAT_STAGES] = {
+	[LAT_HEADER] = "header",
+	[LAT_BODY] = "body",
+	[LAT_TOTAL] = "total",
+};
+
+enum {
+	CNT_REPORTS,
+	CNT_BYTES_IN,
+	CNT_BYTES_OUT,
+	CNT_DROPS,
+	CNT_BUS_ERRORS,
+	CNT_LOGIC_ERRORS,
+	CNT_REGULATOR_ERRORS,
+	CNT_DEVICE_RESETS,
+	CNT_RESYNC,
+	CNT_PROTOCOL_RESET,
+	CNT_HARD_RESET,
+	CNT_COUNT,
+};
+
+struct sample {
+	bool ready;
+	char runtime[16];
+	char idle[16];
+	uint64_t count[CNT_COUNT];
+	uint64_t by_id[256];
+	uint64_t lat[LAT_STAGES][LAT_BUCKETS];
+	bool have_stats;
+	bool have_lat;
+};
+
+struct device {
+	char name[64];
+	struct sample s[2];
+	int cur;
+	bool primed;
+
+	double reports_per_sec;
+	double bytes_per_sec;
+	double id_per_sec[256];
+	uint64_t lat_pct[LAT_STAGES][3];	/* ns, over the last interval */
+};
+
+static struct device devices[MAX_DEVICES];
+static int ndevices;
+static char events[MAX_EVENTS][192];
+static int nevents;
+static char buf[32768];
+static FILE *csv;
+static volatile sig_atomic_t quit;
+
+static void on_signal(int sig)
+{
+	quit = 1;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Reads @path into the shared buffer, returns the length or -1 */
+static ssize_t read_file(const char *dir, const char *dev, const char *file)
+{
+	char path[256];
+	ssize_t len;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s/%s", dir, dev, file);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len < 0)
+		return -1;
+	buf[len] = '\0';
+
+	return len;
+}
+
+static uint64_t read_u64(const char *dev, const char *file)
+{
+	if (read_file(DRIVER_DIR, dev, file) < 0)
+		return 0;
+
+	return strtoull(buf, NULL, 10);
+}
+
+static void read_word(const char *dev, const char *file, char *word,
+		size_t size)
+{
+	snprintf(word, size, "-");
+	if (read_file(DRIVER_DIR, dev, file) < 0)
+		return;
+
+	sscanf(buf, "%15s", word);
+}
+
+static void add_event(const struct device *d, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+static void add_event(const struct device *d, const char *fmt, ...)
+{
+	char msg[96];
+	char stamp[16];
+	time_t t = time(NULL);
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(msg, sizeof(msg), fmt, ap);
+	va_end(ap);
+
+	strftime(stamp, sizeof(stamp), "%H:%M:%S", localtime(&t));
+
+	if (nevents == MAX_EVENTS) {
+		memmove(events[0], events[1], sizeof(events[0]) * (MAX_EVENTS - 1));
+		nevents--;
+	}
+	snprintf(events[nevents++], sizeof(events[0]), "%s %s: %s", stamp,
+			d->name, msg);
+}
+
+static void parse_stats(struct sample *s)
+{
+	static const struct {
+		const char *key;
+		int counter;
+	} keys[] = {
+		{ "reports", CNT_REPORTS },
+		{ "bytes_in", CNT_BYTES_IN },
+		{ "bytes_out", CNT_BYTES_OUT },
+		{ "drops", CNT_DROPS },
+	};
+	char *line, *save;
+	char key[32];
+	unsigned long long val;
+	unsigned int id;
+	size_t i;
+
+	memset(s->by_id, 0, sizeof(s->by_id));
+
+	for (line = strtok_r(buf, "\n", &save); line;
+			line = strtok_r(NULL, "\n", &save)) {
+		if (sscanf(line, "%31s %llu", key, &val) != 2)
+			continue;
+
+		if (sscanf(key, "id_0x%x", &id) == 1 && id < 256) {
+			s->by_id[id] = val;
+			continue;
+		}
+
+		for (i = 0; i < sizeof(keys) / sizeof(keys[0]); i++)
+			if (!strcmp(key, keys[i].key))
+				s->count[keys[i].counter] = val;
+	}
+}
+
+static void parse_latency_hist(struct sample *s)
+{
+	unsigned long long lo, hi, count;
+	char *line, *save;
+	char name[32];
+	int stage = -1, i;
+
+	memset(s->lat, 0, sizeof(s->lat));
+
+	for (line = strtok_r(buf, "\n", &save); line;
+			line = strtok_r(NULL, "\n", &save)) {
+		if (sscanf(line, " [%llu, %llu) %llu", &lo, &hi, &count) == 3) {
+			if (stage < 0 || !hi)
+				continue;
+			i = 63 - __builtin_clzll(hi);
+			if (i < LAT_BUCKETS)
+				s->lat[stage][i] = count;
+			continue;
+		}
+
+		stage = -1;
+		if (sscanf(line, "%31s", name) != 1)
+			continue;
+		for (i = 0; i < LAT_STAGES; i++)
+			if (!strcmp(name, lat_names[i]))
+				stage = i;
+	}
+}
+
+static void poll_device(struct device *d)
+{
+	struct sample *s = &d->s[d->cur];
+	unsigned int resync, protocol, hard, coalesced;
+
+	memset(s->count, 0, sizeof(s->count));
+
+	s->ready = read_file(DRIVER_DIR, d->name, "ready") > 0 &&
+			!strncmp(buf, "ready", 5);
+	read_word(d->name, "power/runtime_status", s->runtime,
+			sizeof(s->runtime));
+	snprintf(s->idle, sizeof(s->idle), "-");
+	if (read_file(DRIVER_DIR, d->name, "spi_hid_idle") > 0)
+		sscanf(buf, "idle_ms %*u state %15s", s->idle);
+
+	s->count[CNT_BUS_ERRORS] = read_u64(d->name, "bus_error_count");
+	s->count[CNT_LOGIC_ERRORS] = read_u64(d->name, "logic_error_count");
+	s->count[CNT_REGULATOR_ERRORS] = read_u64(d->name,
+			"regulator_error_count");
+	s->count[CNT_DEVICE_RESETS] = read_u64(d->name,
+			"device_initiated_reset_count");
+
+	if (read_file(DRIVER_DIR, d->name, "recovery_count") > 0 &&
+			sscanf(buf, "resync %u protocol %u hard %u coalesced %u",
+				&resync, &protocol, &hard, &coalesced) == 4) {
+		s->count[CNT_RESYNC] = resync;
+		s->count[CNT_PROTOCOL_RESET] = protocol;
+		s->count[CNT_HARD_RESET] = hard;
+	}
+
+	s->have_stats = read_file(DEBUGFS_DIR, d->name, "stats") > 0;
+	if (s->have_stats)
+		parse_stats(s);
+
+	s->have_lat = read_file(DEBUGFS_DIR, d->name, "latency_hist") > 0;
+	if (s->have_lat)
+		parse_latency_hist(s);
+}
+
+/* Upper bound of the bucket holding @permille of the interval's samples */
+static uint64_t lat_percentile(const uint64_t *delta, uint64_t total,
+		unsigned int permille)
+{
+	uint64_t rank = (total * permille + 999) / 1000;
+	uint64_t seen = 0;
+	int i;
+
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		seen += delta[i];
+		if (seen >= rank)
+			break;
+	}
+
+	return i ? 1ULL << (i < 63 ? i : 63) : 0;
+}
+
+static void update_device(struct device *d, double secs)
+{
+	const struct sample *s = &d->s[d->cur], *p = &d->s[!d->cur];
+	uint64_t delta[LAT_BUCKETS], total, diff;
+	int i, j;
+
+	if (!d->primed)
+		return;
+
+	if (s->ready != p->ready)
+		add_event(d, "%s", s->ready ? "ready" : "not ready");
+	if (strcmp(s->runtime, p->runtime))
+		add_event(d, "runtime %s -> %s", p->runtime, s->runtime);
+
+#define CHECK(counter, what)						\
+	do {								\
+		diff = s->count[counter] - p->count[counter];		\
+		if (s->count[counter] > p->count[counter])		\
+			add_event(d, "+%llu %s",			\
+					(unsigned long long)diff, what);	\
+	} while (0)
+
+	CHECK(CNT_DEVICE_RESETS, "device initiated reset(s)");
+	CHECK(CNT_PROTOCOL_RESET, "protocol reset(s)");
+	CHECK(CNT_HARD_RESET, "hard reset(s)");
+	CHECK(CNT_RESYNC, "resync(s)");
+	CHECK(CNT_BUS_ERRORS, "bus error(s)");
+	CHECK(CNT_LOGIC_ERRORS, "logic error(s)");
+	CHECK(CNT_REGULATOR_ERRORS, "regulator error(s)");
+	CHECK(CNT_DROPS, "dropped report(s)");
+#undef CHECK
+
+	/* Counters restart when the driver is reloaded */
+	if (s->have_stats && p->have_stats &&
+			s->count[CNT_REPORTS] >= p->count[CNT_REPORTS]) {
+		d->reports_per_sec = (s->count[CNT_REPORTS] -
+				p->count[CNT_REPORTS]) / secs;
+		d->bytes_per_sec = (s->count[CNT_BYTES_IN] + s->count[CNT_BYTES_OUT] -
+				p->count[CNT_BYTES_IN] - p->count[CNT_BYTES_OUT]) / secs;
+		for (i = 0; i < 256; i++)
+			d->id_per_sec[i] = s->by_id[i] >= p->by_id[i] ?
+					(s->by_id[i] - p->by_id[i]) / secs : 0;
+	}
+
+	memset(d->lat_pct, 0, sizeof(d->lat_pct));
+	if (!s->have_lat || !p->have_lat)
+		return;
+
+	for (i = 0; i < LAT_STAGES; i++) {
+		total = 0;
+		for (j = 0; j < LAT_BUCKETS; j++) {
+			delta[j] = s->lat[i][j] >= p->lat[i][j] ?
+					s->lat[i][j] - p->lat[i][j] : 0;
+			total += delta[j];
+		}
+		if (!total)
+			continue;
+
+		d->lat_pct[i][0] = lat_percentile(delta, total, 500);
+		d->lat_pct[i][1] = lat_percentile(delta, total, 990);
+		d->lat_pct[i][2] = lat_percentile(delta, total, 999);
+	}
+}
+
+static void print_device(const struct device *d)
+{
+	const struct sample *s = &d->s[d->cur];
+	int top[TOP_IDS], ntop = 0;
+	int i, j;
+
+	printf("%s  %s  runtime %s  idle %s\n", d->name,
+			s->ready ? "ready" : "NOT READY", s->runtime, s->idle);
+
+	if (!s->have_stats) {
+		printf("  no debugfs stats (mount debugfs and run as root)\n");
+	} else {
+		printf("  %.0f reports/s  %.1f KiB/s  drops %llu\n",
+				d->reports_per_sec, d->bytes_per_sec / 1024,
+				(unsigned long long)s->count[CNT_DROPS]);
+
+		/* Busiest report IDs first */
+		for (i = 0; i < 256; i++) {
+			if (d->id_per_sec[i] <= 0)
+				continue;
+			j = ntop;
+			if (j == TOP_IDS) {
+				if (d->id_per_sec[i] <= d->id_per_sec[top[j - 1]])
+					continue;
+				j--;
+			}
+			for (; j > 0 && d->id_per_sec[top[j - 1]] <
+					d->id_per_sec[i]; j--)
+				top[j] = top[j - 1];
+			top[j] = i;
+			if (ntop < TOP_IDS)
+				ntop++;
+		}
+		for (i = 0; i < ntop; i++)
+			printf("    id 0x%02x %8.0f/s\n", top[i],
+					d->id_per_sec[top[i]]);
+	}
+
+	if (s->have_lat) {
+		printf("  %-8s %10s %10s %10s\n", "latency", "p50_us",
+				"p99_us", "p999_us");
+		for (i = 0; i < LAT_STAGES; i++)
+			printf("  %-8s %10.1f %10.1f %10.1f\n", lat_names[i],
+					d->lat_pct[i][0] / 1e3,
+					d->lat_pct[i][1] / 1e3,
+					d->lat_pct[i][2] / 1e3);
+	}
+
+	printf("  errors bus %llu logic %llu regulator %llu  resets device %llu protocol %llu hard %llu resync %llu\n",
+			(unsigned long long)s->count[CNT_BUS_ERRORS],
+			(unsigned long long)s->count[CNT_LOGIC_ERRORS],
+			(unsigned long long)s->count[CNT_REGULATOR_ERRORS],
+			(unsigned long long)s->count[CNT_DEVICE_RESETS],
+			(unsigned long long)s->count[CNT_PROTOCOL_RESET],
+			(unsigned long long)s->count[CNT_HARD_RESET],
+			(unsigned long long)s->count[CNT_RESYNC]);
+}
+
+static void csv_header(void)
+{
+	int i;
+
+	fprintf(csv, "time,device,ready,runtime,idle,reports_per_sec,bytes_per_sec");
+	for (i = 0; i < LAT_STAGES; i++)
+		fprintf(csv, ",%s_p50_ns,%s_p99_ns,%s_p999_ns", lat_names[i],
+				lat_names[i], lat_names[i]);
+	fprintf(csv, ",bus_errors,logic_errors,regulator_errors,device_resets,protocol_resets,hard_resets,resyncs,drops,ids\n");
+}
+
+static void csv_row(const struct device *d, time_t t)
+{
+	const struct sample *s = &d->s[d->cur];
+	const char *sep = "";
+	int i;
+
+	fprintf(csv, "%lld,%s,%d,%s,%s,%.1f,%.1f", (long long)t, d->name,
+			s->ready, s->runtime, s->idle, d->reports_per_sec,
+			d->bytes_per_sec);
+	for (i = 0; i < LAT_STAGES; i++)
+		fprintf(csv, ",%llu,%llu,%llu",
+				(unsigned long long)d->lat_pct[i][0],
+				(unsigned long long)d->lat_pct[i][1],
+				(unsigned long long)d->lat_pct[i][2]);
+	fprintf(csv, ",%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,",
+			(unsigned long long)s->count[CNT_BUS_ERRORS],
+			(unsigned long long)s->count[CNT_LOGIC_ERRORS],
+			(unsigned long long)s->count[CNT_REGULATOR_ERRORS],
+			(unsigned long long)s->count[CNT_DEVICE_RESETS],
+			(unsigned long long)s->count[CNT_PROTOCOL_RESET],
+			(unsigned long long)s->count[CNT_HARD_RESET],
+			(unsigned long long)s->count[CNT_RESYNC],
+			(unsigned long long)s->count[CNT_DROPS]);
+
+	/* Per ID rates as id:rate pairs, so the column count stays fixed */
+	for (i = 0; i < 256; i++) {
+		if (d->id_per_sec[i] <= 0)
+			continue;
+		fprintf(csv, "%s%02x:%.1f", sep, i, d->id_per_sec[i]);
+		sep = ";";
+	}
+	fprintf(csv, "\n");
+}
+
+static int find_devices(const char *only)
+{
+	struct dirent *de;
+	DIR *dir;
+
+	if (only) {
+		snprintf(devices[0].name, sizeof(devices[0].name), "%s", only);
+		ndevices = 1;
+		return 0;
+	}
+
+	dir = opendir(DRIVER_DIR);
+	if (!dir)
+		return -1;
+
+	while ((de = readdir(dir)) && ndevices < MAX_DEVICES) {
+		if (de->d_type != DT_LNK || !strcmp(de->d_name, "module"))
+			continue;
+		snprintf(devices[ndevices].name, sizeof(devices[0].name), "%.63s",
+				de->d_name);
+		ndevices++;
+	}
+	closedir(dir);
+
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-i interval_ms] [-n count] [-d device] [-c file.csv] [-b]\n"
+		"\n"
+		"  -i  poll interval in ms (default 1000)\n"
+		"  -n  stop after this many intervals\n"
+		"  -d  only watch this device, e.g. spi-MSHW0231:00\n"
+		"  -c  append one CSV row per device and interval to file\n"
+		"  -b  batch mode, print without clearing the screen\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int interval_ms = 1000;
+	const char *only = NULL, *csv_path = NULL;
+	long count = -1;
+	bool batch = !isatty(STDOUT_FILENO);
+	uint64_t prev_ns = 0, ts;
+	struct timespec delay;
+	time_t t;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "i:n:d:c:bh")) != -1) {
+		switch (opt) {
+		case 'i':
+			interval_ms = strtoul(optarg, NULL, 10);
+			break;
+		case 'n':
+			count = strtol(optarg, NULL, 10);
+			break;
+		case 'd':
+			only = optarg;
+			break;
+		case 'c':
+			csv_path = optarg;
+			break;
+		case 'b':
+			batch = true;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (!interval_ms)
+		interval_ms = 1000;
+
+	if (find_devices(only) < 0 || !ndevices) {
+		fprintf(stderr, "no spi_hid devices found in %s\n", DRIVER_DIR);
+		return 1;
+	}
+
+	if (csv_path) {
+		csv = fopen(csv_path, "a");
+		if (!csv) {
+			perror(csv_path);
+			return 1;
+		}
+		if (!ftell(csv))
+			csv_header();
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	delay.tv_sec = interval_ms / 1000;
+	delay.tv_nsec = (interval_ms % 1000) * 1000000L;
+
+	while (!quit && count) {
+		ts = now_ns();
+		t = time(NULL);
+
+		for (i = 0; i < ndevices; i++) {
+			poll_device(&devices[i]);
+			update_device(&devices[i], (ts - prev_ns) / 1e9);
+		}
+
+		if (!batch)
+			printf("\033[H\033[2J");
+		for (i = 0; i < ndevices; i++) {
+			if (i)
+				printf("\n");
+			print_device(&devices[i]);
+			if (csv && devices[i].primed)
+				csv_row(&devices[i], t);
+		}
+		if (nevents) {
+			printf("\nevents:\n");
+			for (i = 0; i < nevents; i++)
+				printf("  %s\n", events[i]);
+		}
+		if (batch)
+			printf("\n");
+		fflush(stdout);
+		if (csv)
+			fflush(csv);
+
+		for (i = 0; i < ndevices; i++) {
+			devices[i].primed = true;
+			devices[i].cur = !devices[i].cur;
+		}
+		prev_ns = ts;
+
+		if (count > 0)
+			count--;
+		if (count)
+			nanosleep(&delay, NULL);
+	}
+
+	if (csv)
+		fclose(csv);
+
+	return 0;
+}